@@ -1,4 +1,4 @@
-//===- Hello.cpp - Example code from "Writing an LLVM Pass" ---------------===//
+//===- Hello.cpp - Interprocedural constant propagation -------------------===//
 //
 //                     The LLVM Compiler Infrastructure
 //
@@ -7,103 +7,3531 @@
 //
 //===----------------------------------------------------------------------===//
 //
-// This file implements two versions of the LLVM "Hello World" pass described
-// in docs/WritingAnLLVMPass.html
+// This file implements the hello pass, an interprocedural constant
+// propagation over the internal functions of a module. It grew out of the
+// "Hello World" pass of docs/WritingAnLLVMPass.html and runs in phases:
+//
+//  * consumer sets, and a worklist that turns formals passed the same
+//    constant at every call into that constant;
+//  * a solver of small constant sets over formals, returns, struct fields,
+//    internal globals and non-escaping allocas, which follows calls through
+//    traced function pointers and callback brokers, and commits what it
+//    proves;
+//  * known bits, nonnull and dereferenceable facts for pointer and integer
+//    formals;
+//  * specialization of callees, per constant set and per call-string
+//    context;
+//  * removal of the formals that became dead, and a cleanup pipeline over
+//    the functions that changed.
+//
+// The -hello-* options select these, profile guidance, reports and traces,
+// and a compile-time budget.
 //
 //===----------------------------------------------------------------------===//
 
-#include "llvm/ADT/Statistic.h"
-#include "llvm/IR/Function.h"
-#include "llvm/IR/Module.h"
-#include "llvm/IR/CallSite.h"
-#include "llvm/Pass.h"
-#include "llvm/Support/raw_ostream.h"
-#include "llvm/IR/InstIterator.h"
-#include "llvm/IR/Argument.h"
-#include "llvm/Transforms/Scalar.h"
-#include "llvm/Analysis/ConstantFolding.h"
-#include "llvm/IR/Constants.h"
-#include "llvm/IR/Instruction.h"
-#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "HelloPhases.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Argument.h"
+#include "llvm/Transforms/Scalar.h"
+#include "llvm/Analysis/ConstantFolding.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Attributes.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/Support/LineIterator.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Transforms/InstCombine/InstCombine.h"
+
+
+#include <vector>
+#include <map>
+#include <queue>
+#include <set>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <chrono>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+using namespace llvm;
+
+#define DEBUG_TYPE "hello"
+
+STATISTIC(NumInstKilled, "Number of instructions killed");
+STATISTIC(NumConstantsProp, "Number of constant propagated");
+STATISTIC(NumOfArgsPop, "Number of arguments anaylzed");
+STATISTIC(NumBlocksRemoved, "Number of unreachable blocks removed");
+STATISTIC(NumCasesRemoved, "Number of unreachable switch cases removed");
+STATISTIC(NumSpecializations, "Number of specialized function copies");
+STATISTIC(NumContextCalls, "Number of calls redirected to a context copy");
+STATISTIC(NumGlobalLoadsFolded, "Number of loads of constant globals folded");
+STATISTIC(NumGlobalsConstant, "Number of internal globals marked constant");
+STATISTIC(NumArgsRemoved, "Number of constant arguments removed");
+STATISTIC(NumKnownBitsArgs, "Number of formals annotated with known bits");
+STATISTIC(NumNonNullArgs, "Number of formals proven nonnull");
+STATISTIC(NumValueProfiled, "Number of formals instrumented for values");
+STATISTIC(NumGuardedCalls, "Number of calls given a guarded fast path");
+STATISTIC(NumFunctionsCleaned, "Number of changed functions cleaned up");
+STATISTIC(NumBudgetExhausted, "Number of runs that ran out of budget");
+
+static cl::opt<bool> HelloCleanup("hello-cleanup", cl::init(true),
+    cl::desc("Run instcombine, simplifycfg and dce on the functions the "
+             "hello pass changed"));
+
+static cl::opt<bool> HelloDeadArgs("hello-dead-args", cl::init(true),
+    cl::desc("Remove arguments proven constant from internal functions"));
+
+static cl::opt<unsigned> MaxArgConstants("hello-max-constants", cl::init(4),
+    cl::desc("Largest number of distinct constants tracked for one value"));
+
+static cl::opt<bool> HelloSpecialize("hello-specialize", cl::init(false),
+    cl::desc("Clone internal functions for each constant a switched or "
+             "compared formal can take"));
+
+static cl::opt<unsigned> HelloSpecializeMaxSize("hello-specialize-max-size",
+    cl::init(200),
+    cl::desc("Largest function, in instructions, the hello pass will clone"));
+
+static cl::opt<unsigned> HelloContextDepth("hello-context-depth",
+    cl::init(0),
+    cl::desc("Length (0 to 2) of the call strings callees are analyzed and "
+             "cloned for; 0 disables context sensitivity"));
+
+static cl::opt<unsigned> HelloMaxContexts("hello-max-contexts", cl::init(64),
+    cl::desc("Most calling contexts the hello pass will clone for"));
+
+static cl::opt<bool> HelloProfile("hello-profile", cl::init(false),
+    cl::desc("Use the entry counts and branch weights of an instrumentation "
+             "profile to order and gate the hello pass's work"));
+
+static cl::opt<unsigned> HelloSpecializeMinCount("hello-specialize-min-count",
+    cl::init(0),
+    cl::desc("Fewest profiled executions of the calls a specialized copy "
+             "must serve"));
+
+static cl::opt<bool> HelloSkipCold("hello-skip-cold", cl::init(false),
+    cl::desc("Do not analyze or transform functions the profile shows as "
+             "cold"));
+
+static cl::opt<unsigned> HelloColdCount("hello-cold-count", cl::init(0),
+    cl::desc("Largest profiled entry count of a cold function"));
+
+static cl::opt<std::string> HelloValueProfileGen("hello-value-profile-gen",
+    cl::value_desc("filename"),
+    cl::desc("Count the values taken by switched or compared integer formals "
+             "and append them to this file when the program exits"));
+
+static cl::opt<std::string> HelloValueProfileUse("hello-value-profile-use",
+    cl::value_desc("filename"),
+    cl::desc("Give calls a fast path to a copy specialized for the value a "
+             "formal mostly takes in this value profile"));
+
+static cl::opt<unsigned> HelloValueProfileSlots("hello-value-profile-slots",
+    cl::init(4),
+    cl::desc("Distinct values counted per instrumented formal"));
+
+static cl::opt<unsigned> HelloValueProfileMinPercent(
+    "hello-value-profile-min-percent", cl::init(80),
+    cl::desc("Share of calls, in percent, a profiled value needs before "
+             "calls are guarded on it"));
+
+static cl::opt<bool> HelloKnownBits("hello-known-bits", cl::init(true),
+    cl::desc("Propagate the known bits and alignment of actuals into the "
+             "formals of internal functions"));
+
+static cl::opt<bool> HelloNonNull("hello-nonnull", cl::init(true),
+    cl::desc("Mark pointer formals of internal functions nonnull and "
+             "dereferenceable when every actual is"));
+
+static cl::opt<std::string> HelloTimeReport("hello-time-report",
+    cl::value_desc("text|json"),
+    cl::desc("Report the time and memory each phase of the hello pass took"));
+
+static cl::opt<std::string> HelloTimeReportFile("hello-time-report-file",
+    cl::value_desc("filename"),
+    cl::desc("Write the -hello-time-report here instead of stderr"));
+
+static cl::opt<unsigned> HelloFunctionCosts("hello-function-costs",
+    cl::init(0), cl::value_desc("N"),
+    cl::desc("Print the N functions the hello pass spent the most time on, "
+             "with their worklist pops, folds and consumer edges"));
+
+static cl::opt<std::string> HelloTrace("hello-trace",
+    cl::value_desc("filename"),
+    cl::desc("Write the phases, SCCs, folded functions and worklist sizes "
+             "of the hello pass to this file as Chrome trace events"));
+
+static cl::opt<std::string> HelloRemarksOutput("hello-remarks-output",
+    cl::value_desc("filename"),
+    cl::desc("Write the optimization remarks of the hello pass to this file "
+             "as YAML"));
+
+// Running out of budget while the constant-set solver runs costs most of
+// its constants: every function it has not solved since its inputs last
+// changed passes on only its literal actuals, and everything else it passes
+// is overdefined.
+static cl::opt<unsigned> HelloBudgetMs("hello-budget-ms", cl::init(0),
+    cl::desc("Wall time, in milliseconds, after which the hello pass stops "
+             "analyzing and keeps only what it has proven; 0 is unlimited. "
+             "Most constant sets are lost if it runs out while they are "
+             "being solved"));
+
+static cl::opt<unsigned> HelloBudgetWork("hello-budget-work", cl::init(0),
+    cl::desc("Work units (worklist pops, consumer visits, solves and "
+             "folds) after which the hello pass stops analyzing; 0 is "
+             "unlimited. Most constant sets are lost if it runs out while "
+             "they are being solved"));
+
+// Phase times of the last run, for tools that link the pass in.
+static std::vector<hello::PhaseTime> LastRunPhaseTimes;
+
+const std::vector<hello::PhaseTime> &hello::getLastRunPhaseTimes() {
+  return LastRunPhaseTimes;
+}
+
+namespace {
+  /// PhaseTimers - The -time-passes timers of the hello pass's phases. The
+  /// timers are declared after the group so that they leave it, and get
+  /// printed with it, before it is destroyed.
+  struct PhaseTimers {
+    TimerGroup Group;
+    std::map<std::string, std::unique_ptr<Timer>> Timers;
+
+    PhaseTimers() : Group("Hello pass phases") {}
+
+    Timer &get(const char *Name) {
+      std::unique_ptr<Timer> &T = Timers[Name];
+      if (!T)
+        T.reset(new Timer(Name, Group));
+      return *T;
+    }
+  };
+}
+
+static ManagedStatic<PhaseTimers> HelloPhaseTimers;
+
+// isSubPhaseTimingEnabled - Whether phases that run in many small pieces,
+// whose timing would cost more than they do, are timed.
+static bool isSubPhaseTimingEnabled() {
+  return TimePassesIsEnabled || !HelloTimeReport.empty();
+}
+
+// getPeakRSS - The most memory the process has had resident, in bytes, or
+// 0 where that is unknown.
+static uint64_t getPeakRSS() {
+#if defined(__unix__) || defined(__APPLE__)
+  struct rusage Usage;
+  if (getrusage(RUSAGE_SELF, &Usage) != 0)
+    return 0;
+#if defined(__APPLE__)
+  return uint64_t(Usage.ru_maxrss);
+#else
+  return uint64_t(Usage.ru_maxrss) * 1024;
+#endif
+#else
+  return 0;
+#endif
+}
+
+namespace {
+  /// PhaseScope - Adds the time and memory between its construction and
+  /// destruction to the named phase of LastRunPhaseTimes, and runs the
+  /// phase's timer meanwhile under -time-passes. Scopes nest: the time of
+  /// an inner phase is also part of the outer one.
+  class PhaseScope {
+    bool Enabled;
+    size_t Index;
+    TimeRecord Start;
+    Timer *PhaseTimer;
+
+  public:
+    explicit PhaseScope(const char *Name, bool Enabled = true)
+      : Enabled(Enabled), Index(0), PhaseTimer(nullptr) {
+      if (!Enabled)
+        return;
+      // An index, since inner scopes may grow the vector.
+      for (Index = 0; Index != LastRunPhaseTimes.size(); ++Index)
+        if (StringRef(LastRunPhaseTimes[Index].Name) == Name)
+          break;
+      if (Index == LastRunPhaseTimes.size()) {
+        hello::PhaseTime Phase = { Name, 0, 0, 0, 0, 0, 0 };
+        LastRunPhaseTimes.push_back(Phase);
+      }
+      if (TimePassesIsEnabled) {
+        PhaseTimer = &HelloPhaseTimers->get(Name);
+        PhaseTimer->startTimer();
+      }
+      Start = TimeRecord::getCurrentTime(true);
+    }
+
+    ~PhaseScope() {
+      if (!Enabled)
+        return;
+      TimeRecord End = TimeRecord::getCurrentTime(false);
+      if (PhaseTimer)
+        PhaseTimer->stopTimer();
+      hello::PhaseTime &Phase = LastRunPhaseTimes[Index];
+      ++Phase.Pieces;
+      Phase.WallSeconds += End.getWallTime() - Start.getWallTime();
+      Phase.UserSeconds += End.getUserTime() - Start.getUserTime();
+      Phase.SystemSeconds += End.getSystemTime() - Start.getSystemTime();
+      Phase.MallocBytes += int64_t(End.getMemUsed()) -
+                           int64_t(Start.getMemUsed());
+      Phase.PeakRSSBytes = getPeakRSS();
+    }
+  };
+}
+
+namespace {
+  /// FunctionCost - The work the hello pass did on behalf of one function:
+  /// the time spent finding its consumers, checking its formals and folding
+  /// its body, how often its formals came off the worklist, the values it
+  /// folded, and the getConsumers visits and consumer edges its formals
+  /// produced.
+  struct FunctionCost {
+    double Seconds = 0;
+    uint64_t Pops = 0;
+    uint64_t Folded = 0;
+    uint64_t ConsumerVisits = 0;
+    uint64_t ConsumerEdges = 0;
+  };
+
+  /// CostTimer - Adds the wall time of its scope to Cost, if there is one.
+  /// A steady clock, since these scopes are far too many for the rusage
+  /// and malloc statistics TimeRecord reads.
+  class CostTimer {
+    typedef std::chrono::steady_clock Clock;
+    FunctionCost *Cost;
+    Clock::time_point Start;
+
+  public:
+    explicit CostTimer(FunctionCost *Cost) : Cost(Cost) {
+      if (Cost)
+        Start = Clock::now();
+    }
+
+    ~CostTimer() {
+      if (Cost)
+        Cost->Seconds +=
+          std::chrono::duration<double>(Clock::now() - Start).count();
+    }
+  };
+}
+
+// printFunctionCosts - The Limit most expensive functions in Costs, by time
+// and then by worklist pops.
+static void printFunctionCosts(raw_ostream &OS,
+                               const StringMap<FunctionCost> &Costs,
+                               unsigned Limit) {
+  std::vector<const StringMapEntry<FunctionCost> *> Sorted;
+  for (const StringMapEntry<FunctionCost> &Entry : Costs)
+    Sorted.push_back(&Entry);
+  std::sort(Sorted.begin(), Sorted.end(),
+            [](const StringMapEntry<FunctionCost> *A,
+               const StringMapEntry<FunctionCost> *B) {
+              if (A->getValue().Seconds != B->getValue().Seconds)
+                return A->getValue().Seconds > B->getValue().Seconds;
+              if (A->getValue().Pops != B->getValue().Pops)
+                return A->getValue().Pops > B->getValue().Pops;
+              return A->getKey() < B->getKey();
+            });
+  if (Sorted.size() > Limit)
+    Sorted.resize(Limit);
+
+  OS << "===" << std::string(73, '-') << "===\n"
+     << "         Hello pass cost by function (top " << Sorted.size()
+     << " of " << Costs.size() << ")\n"
+     << "===" << std::string(73, '-') << "===\n"
+     << "   Time (s)      Pops    Folded    Visits     Edges  Function\n";
+  for (const StringMapEntry<FunctionCost> *Entry : Sorted) {
+    const FunctionCost &Cost = Entry->getValue();
+    OS << format("%11.6f%10llu%10llu%10llu%10llu  ", Cost.Seconds,
+                 (unsigned long long)Cost.Pops,
+                 (unsigned long long)Cost.Folded,
+                 (unsigned long long)Cost.ConsumerVisits,
+                 (unsigned long long)Cost.ConsumerEdges)
+       << (Entry->getKey().empty() ? StringRef("<unnamed>") : Entry->getKey())
+       << '\n';
+  }
+  OS << '\n';
+}
+
+namespace {
+  /// TraceWriter - Streams Chrome trace events (the JSON that chrome://tracing
+  /// and Perfetto load) to a file as the pass runs. Spans are written as
+  /// separate begin and end events so that nothing is held in memory, and
+  /// the samples of each counter are thinned to one per SampleMicros.
+  class TraceWriter {
+    typedef std::chrono::steady_clock Clock;
+    static const unsigned SampleMicros = 100;
+
+    std::unique_ptr<raw_fd_ostream> OS;
+    Clock::time_point Origin;
+    // When each counter was last sampled.
+    StringMap<double> LastSample;
+    bool First;
+
+    double now() const {
+      return std::chrono::duration<double, std::micro>(Clock::now() - Origin)
+        .count();
+    }
+
+    void writeString(StringRef Str) {
+      *OS << '"';
+      for (unsigned char C : Str) {
+        if (C == '"' || C == '\\')
+          *OS << '\\' << C;
+        else if (C < 0x20)
+          *OS << format("\\u%04x", C);
+        else
+          *OS << C;
+      }
+      *OS << '"';
+    }
+
+    // startEvent - Everything up to the closing brace of an event.
+    void startEvent(char Phase, StringRef Name, StringRef Category,
+                    double Time) {
+      *OS << (First ? "\n" : ",\n") << "{\"ph\":\"" << Phase
+          << "\",\"pid\":1,\"tid\":1,\"ts\":" << format("%.3f", Time);
+      First = false;
+      if (!Name.empty()) {
+        *OS << ",\"name\":";
+        writeString(Name);
+      }
+      if (!Category.empty()) {
+        *OS << ",\"cat\":";
+        writeString(Category);
+      }
+    }
+
+  public:
+    TraceWriter() : First(true) {}
+
+    bool isOpen() const { return OS != nullptr; }
+
+    bool open(StringRef Filename) {
+      std::error_code EC;
+      OS.reset(new raw_fd_ostream(Filename, EC, sys::fs::F_Text));
+      if (EC) {
+        errs() << "hello: " << Filename << ": " << EC.message() << '\n';
+        OS.reset();
+        return false;
+      }
+      Origin = Clock::now();
+      LastSample.clear();
+      First = true;
+      *OS << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+      return true;
+    }
+
+    void close() {
+      if (!OS)
+        return;
+      *OS << "\n]}\n";
+      OS.reset();
+    }
+
+    void begin(StringRef Name, StringRef Category) {
+      startEvent('B', Name, Category, now());
+      *OS << '}';
+    }
+
+    void begin(StringRef Name, StringRef Category, StringRef ArgName,
+               uint64_t ArgValue) {
+      startEvent('B', Name, Category, now());
+      *OS << ",\"args\":{";
+      writeString(ArgName);
+      *OS << ':' << ArgValue << "}}";
+    }
+
+    void end() {
+      startEvent('E', "", "", now());
+      *OS << '}';
+    }
+
+    // sample - Record Value as the current value of the counter Name,
+    // unless Name was sampled within the last SampleMicros.
+    void sample(StringRef Name, uint64_t Value) {
+      double Time = now();
+      StringMap<double>::iterator Last = LastSample.find(Name);
+      if (Last == LastSample.end())
+        LastSample[Name] = Time;
+      else if (Time - Last->second < SampleMicros)
+        return;
+      else
+        Last->second = Time;
+      startEvent('C', Name, "", Time);
+      *OS << ",\"args\":{\"size\":" << Value << "}}";
+    }
+  };
+}
+
+static ManagedStatic<TraceWriter> HelloTraceWriter;
+
+// isTracing - Whether -hello-trace is writing events.
+static bool isTracing() {
+  return !HelloTrace.empty() && HelloTraceWriter->isOpen();
+}
+
+namespace {
+  /// TraceSpan - A span of the -hello-trace covering its scope, if the
+  /// trace is being written.
+  class TraceSpan {
+    bool Active;
+
+  public:
+    TraceSpan(StringRef Name, StringRef Category) : Active(isTracing()) {
+      if (Active)
+        HelloTraceWriter->begin(Name, Category);
+    }
+
+    TraceSpan(StringRef Name, StringRef Category, StringRef ArgName,
+              uint64_t ArgValue) : Active(isTracing()) {
+      if (Active)
+        HelloTraceWriter->begin(Name, Category, ArgName, ArgValue);
+    }
+
+    ~TraceSpan() {
+      if (Active)
+        HelloTraceWriter->end();
+    }
+  };
+}
+
+namespace {
+  /// CompileBudget - How much more the pass may do in one run, as a wall
+  /// time deadline and a number of work units. The clock is only read
+  /// every 64 units, so spending is a couple of compares.
+  class CompileBudget {
+    typedef std::chrono::steady_clock Clock;
+    static const unsigned CheckInterval = 64;
+
+    uint64_t WorkLimit;
+    uint64_t Work;
+    unsigned SinceCheck;
+    bool HasDeadline;
+    bool Exhausted;
+    Clock::time_point Start;
+    Clock::time_point Deadline;
+
+  public:
+    CompileBudget()
+      : WorkLimit(0), Work(0), SinceCheck(0), HasDeadline(false),
+        Exhausted(false) {}
+
+    void start(uint64_t Units, unsigned Millis) {
+      WorkLimit = Units;
+      Work = 0;
+      SinceCheck = 0;
+      Exhausted = false;
+      Start = Clock::now();
+      HasDeadline = Millis != 0;
+      Deadline = Start + std::chrono::milliseconds(Millis);
+    }
+
+    bool isExhausted() const { return Exhausted; }
+    uint64_t getWork() const { return Work; }
+
+    double getElapsedMillis() const {
+      return std::chrono::duration<double, std::milli>(Clock::now() - Start)
+        .count();
+    }
+
+    // spend - Account for Units of work; false once the budget is gone.
+    bool spend(unsigned Units = 1) {
+      if (Exhausted)
+        return false;
+      Work += Units;
+      SinceCheck += Units;
+      if (WorkLimit && Work > WorkLimit)
+        Exhausted = true;
+      else if (HasDeadline && SinceCheck >= CheckInterval) {
+        SinceCheck = 0;
+        Exhausted = Clock::now() >= Deadline;
+      }
+      return !Exhausted;
+    }
+  };
+}
+
+// printPhaseReportText - The phases of the last run as a table.
+static void printPhaseReportText(raw_ostream &OS) {
+  OS << "===" << std::string(73, '-') << "===\n"
+     << "                       Hello pass phase report\n"
+     << "===" << std::string(73, '-') << "===\n"
+     << "   Wall (s)   User (s) System (s)  Pieces  Malloc (KB)"
+     << "  Peak RSS (KB)  Phase\n";
+  for (const hello::PhaseTime &Phase : LastRunPhaseTimes)
+    OS << format("%11.4f%11.4f%11.4f%8u%13lld%15llu  ", Phase.WallSeconds,
+                 Phase.UserSeconds, Phase.SystemSeconds, Phase.Pieces,
+                 (long long)(Phase.MallocBytes / 1024),
+                 (unsigned long long)(Phase.PeakRSSBytes / 1024))
+       << Phase.Name << '\n';
+  OS << '\n';
+}
+
+// printPhaseReportJSON - The phases of the last run as one JSON object.
+static void printPhaseReportJSON(raw_ostream &OS, StringRef ModuleName) {
+  OS << "{\"module\": \"";
+  OS.write_escaped(ModuleName);
+  OS << "\", \"phases\": [";
+  for (unsigned i = 0, e = LastRunPhaseTimes.size(); i != e; ++i) {
+    const hello::PhaseTime &Phase = LastRunPhaseTimes[i];
+    OS << (i ? ",\n  " : "\n  ") << "{\"name\": \"" << Phase.Name
+       << "\", \"pieces\": " << Phase.Pieces
+       << format(", \"wall\": %.6f, \"user\": %.6f, \"sys\": %.6f",
+                 Phase.WallSeconds, Phase.UserSeconds, Phase.SystemSeconds)
+       << ", \"malloc_bytes\": " << Phase.MallocBytes
+       << ", \"peak_rss_bytes\": " << Phase.PeakRSSBytes << '}';
+  }
+  OS << "\n]}\n";
+}
+
+// printPhaseReport - Write the -hello-time-report of the last run.
+static void printPhaseReport(Module &M) {
+  bool JSON = HelloTimeReport == "json";
+  if (!JSON && HelloTimeReport != "text") {
+    errs() << "hello: unknown -hello-time-report format '" << HelloTimeReport
+           << "', expected text or json\n";
+    return;
+  }
+
+  std::unique_ptr<raw_fd_ostream> File;
+  if (!HelloTimeReportFile.empty()) {
+    std::error_code EC;
+    File.reset(new raw_fd_ostream(HelloTimeReportFile, EC,
+                                  sys::fs::F_Text | sys::fs::F_Append));
+    if (EC) {
+      errs() << "hello: " << HelloTimeReportFile << ": " << EC.message()
+             << '\n';
+      return;
+    }
+  }
+  raw_ostream &OS = File ? static_cast<raw_ostream &>(*File) : errs();
+  if (JSON)
+    printPhaseReportJSON(OS, M.getModuleIdentifier());
+  else
+    printPhaseReportText(OS);
+}
+
+namespace {
+  /// Remark - One optimization remark of the hello pass, kept as the named
+  /// parts of the YAML remark format; its message is the parts joined.
+  /// Remarks are only built when they are enabled.
+  struct Remark {
+    bool Passed;
+    const char *Name;
+    const Function &Fn;
+    DebugLoc Loc;
+    std::vector<std::pair<const char *, std::string>> Args;
+
+    Remark(bool Passed, const char *Name, const Function &Fn,
+           const DebugLoc &Loc = DebugLoc())
+      : Passed(Passed), Name(Name), Fn(Fn), Loc(Loc) {}
+
+    Remark &operator<<(StringRef Str) {
+      Args.push_back(std::make_pair("String", Str.str()));
+      return *this;
+    }
+
+    // arg - A value the remark is about: a named function, formal or
+    // global by its name, anything else as the IR prints it.
+    Remark &arg(const char *Key, const Value *V) {
+      std::string Str;
+      if (V->hasName() && !isa<Instruction>(V)) {
+        Str = V->getName();
+      } else {
+        raw_string_ostream OS(Str);
+        V->print(OS);
+      }
+      Args.push_back(std::make_pair(Key, Str));
+      return *this;
+    }
+
+    Remark &arg(const char *Key, uint64_t N) {
+      Args.push_back(std::make_pair(Key, std::to_string(N)));
+      return *this;
+    }
+
+    std::string getMessage() const {
+      std::string Msg;
+      for (auto &Arg : Args)
+        Msg += Arg.second;
+      return Msg;
+    }
+  };
+}
+
+// areRemarksRequested - Whether -pass-remarks or -pass-remarks-missed
+// selects the hello pass. There is no way to ask but through a remark.
+static bool areRemarksRequested(Module &M) {
+  if (M.empty())
+    return false;
+  const Function &F = *M.begin();
+  return DiagnosticInfoOptimizationRemark(DEBUG_TYPE, F, DebugLoc(), "")
+           .isEnabled() ||
+         DiagnosticInfoOptimizationRemarkMissed(DEBUG_TYPE, F, DebugLoc(), "")
+           .isEnabled();
+}
+
+// writeYAMLString - Str as a single-quoted YAML scalar.
+static void writeYAMLString(raw_ostream &OS, StringRef Str) {
+  OS << '\'';
+  for (char C : Str) {
+    if (C == '\'')
+      OS << '\'';
+    OS << C;
+  }
+  OS << '\'';
+}
+
+// writeRemarkYAML - R as one document of the YAML remark format.
+static void writeRemarkYAML(raw_ostream &OS, const Remark &R) {
+  OS << "--- !" << (R.Passed ? "Passed" : "Missed") << '\n'
+     << "Pass:            " DEBUG_TYPE "\n"
+     << "Name:            " << R.Name << '\n';
+  if (R.Loc) {
+    OS << "DebugLoc:        { File: ";
+    writeYAMLString(OS, cast<DIScope>(R.Loc.getScope())->getFilename());
+    OS << ", Line: " << R.Loc.getLine() << ", Column: " << R.Loc.getCol()
+       << " }\n";
+  }
+  OS << "Function:        ";
+  writeYAMLString(OS, R.Fn.getName());
+  OS << "\nArgs:\n";
+  for (auto &Arg : R.Args) {
+    OS << "  - " << Arg.first << ": ";
+    writeYAMLString(OS, Arg.second);
+    OS << '\n';
+  }
+  OS << "...\n";
+}
+
+namespace {
+  /// LatticeVal - What the solver knows about one value: nothing yet
+  /// (undefined), one of a small set of constants, or overdefined. The set
+  /// holds at most MaxArgConstants entries; a set of one is a plain constant.
+  struct LatticeVal {
+    enum StateTy { Undefined, ConstSet, Overdefined };
+    StateTy State;
+    SmallVector<Constant*, 4> Values;
+
+    LatticeVal() : State(Undefined) {}
+
+    bool isUndefined() const { return State == Undefined; }
+    bool isConstantSet() const { return State == ConstSet; }
+    bool isConstant() const { return State == ConstSet && Values.size() == 1; }
+    bool isOverdefined() const { return State == Overdefined; }
+    Constant *getConstant() const { return isConstant() ? Values[0] : nullptr; }
+
+    bool contains(Constant *C) const {
+      return std::find(Values.begin(), Values.end(), C) != Values.end();
+    }
+
+    static LatticeVal get(Constant *C) {
+      LatticeVal V;
+      V.insert(C);
+      return V;
+    }
+    static LatticeVal getOverdefined() {
+      LatticeVal V;
+      V.markOverdefined();
+      return V;
+    }
+
+    bool markOverdefined() {
+      if (isOverdefined())
+        return false;
+      State = Overdefined;
+      Values.clear();
+      return true;
+    }
+
+    /// insert - Add C, going overdefined once the set grows past the bound.
+    /// Returns true if the value changed.
+    bool insert(Constant *C) {
+      if (isOverdefined() || contains(C))
+        return false;
+      if (Values.size() >= MaxArgConstants)
+        return markOverdefined();
+      State = ConstSet;
+      Values.push_back(C);
+      return true;
+    }
+
+    /// mergeIn - Meet Other into this value, returning true if it changed.
+    bool mergeIn(const LatticeVal &Other) {
+      if (Other.isOverdefined())
+        return markOverdefined();
+      bool Changed = false;
+      for (Constant *C : Other.Values)
+        Changed |= insert(C);
+      return Changed;
+    }
+  };
+
+  typedef std::map<Argument*, LatticeVal> ArgStateMap;
+  typedef std::map<Function*, LatticeVal> ReturnStateMap;
+  typedef std::map<GlobalVariable*, LatticeVal> GlobalStateMap;
+  typedef std::map<std::pair<Function*, unsigned>, LatticeVal> FieldStateMap;
+
+  /// ArgFact - What holds for an integer or pointer formal at every call,
+  /// short of it being constant: the bits known to be zero and known to be
+  /// one, and for pointers whether they are nonnull and how many bytes are
+  /// dereferenceable. A fact that has not seen a call yet knows everything.
+  struct ArgFact {
+    bool Seen;
+    APInt Zero, One;
+    bool NonNull;
+    uint64_t DerefBytes;
+
+    ArgFact() : Seen(false), NonNull(false), DerefBytes(0) {}
+
+    bool knowsAnything() const {
+      return Seen && (!!Zero || !!One || NonNull || DerefBytes);
+    }
+
+    bool operator==(const ArgFact &Other) const {
+      return Seen == Other.Seen && Zero == Other.Zero && One == Other.One &&
+             NonNull == Other.NonNull && DerefBytes == Other.DerefBytes;
+    }
+    bool operator!=(const ArgFact &Other) const { return !(*this == Other); }
+
+    /// meet - Keep only what Other also knows. Returns true on change.
+    bool meet(const ArgFact &Other) {
+      if (!Other.Seen)
+        return false;
+      if (!Seen) {
+        *this = Other;
+        return true;
+      }
+      ArgFact Old = *this;
+      Zero &= Other.Zero;
+      One &= Other.One;
+      NonNull &= Other.NonNull;
+      DerefBytes = std::min(DerefBytes, Other.DerefBytes);
+      return *this != Old;
+    }
+  };
+
+  /// CallEdge - A call that can invoke Callee. An ordinary call passes its
+  /// own arguments to Callee. A call to a broker such as pthread_create or
+  /// qsort instead hands Callee over to be invoked later; ArgMap then gives,
+  /// for each formal of Callee, the broker operand it will receive, or -1
+  /// when the broker supplies that argument itself.
+  struct CallEdge {
+    CallSite CS;
+    Function *Callee;
+    bool Broker;
+    std::vector<int> ArgMap;
+
+    CallEdge(CallSite CS, Function *Callee)
+      : CS(CS), Callee(Callee), Broker(false) {}
+    CallEdge(CallSite CS, Function *Callee, const std::vector<int> &ArgMap)
+      : CS(CS), Callee(Callee), Broker(true), ArgMap(ArgMap) {}
+
+    /// getActual - The value formal ArgNo of Callee receives along this
+    /// edge, or null if it is not known.
+    Value *getActual(unsigned ArgNo) const {
+      if (!Broker)
+        return ArgNo < CS.arg_size() ? CS.getArgument(ArgNo) : nullptr;
+      FunctionType *FTy = Callee->getFunctionType();
+      if (ArgNo >= ArgMap.size() || ArgNo >= FTy->getNumParams() ||
+          ArgMap[ArgNo] < 0 || unsigned(ArgMap[ArgNo]) >= CS.arg_size())
+        return nullptr;
+      Value *V = CS.getArgument(ArgMap[ArgNo]);
+      return V->getType() == FTy->getParamType(ArgNo) ? V : nullptr;
+    }
+  };
+
+  /// KnownBrokers - Library functions that call back a function passed to
+  /// them: the operand holding the callback and, in order, the operands its
+  /// arguments come from. Only trusted for declarations of these names.
+  struct BrokerInfo {
+    const char *Name;
+    int CalleeNo;
+    int Args[3];
+    unsigned NumArgs;
+  };
+  const BrokerInfo KnownBrokers[] = {
+    { "pthread_create", 2, { 3 }, 1 },
+    { "pthread_once", 1, { }, 0 },
+    { "qsort", 3, { -1, -1 }, 2 },
+    { "qsort_r", 3, { -1, -1, 4 }, 3 },
+    { "bsearch", 4, { -1, -1 }, 2 },
+    { "atexit", 0, { }, 0 },
+    { "__cxa_atexit", 0, { 1 }, 1 },
+    { "signal", 1, { -1 }, 1 },
+  };
+
+  /// getBrokerArgMap - If a call to Broker invokes the function passed as
+  /// operand OpNo, fill ArgMap with where that function's arguments come
+  /// from, per Broker's !callback metadata or the table of known brokers.
+  bool getBrokerArgMap(const Function *Broker, unsigned OpNo,
+                       std::vector<int> &ArgMap) {
+    if (MDNode *Callbacks = Broker->getMetadata("callback")) {
+      // Each encoding is the callee operand, the operand of every argument
+      // (-1 if unknown) and a flag for forwarded varargs, which we ignore.
+      for (const MDOperand &Op : Callbacks->operands()) {
+        MDNode *Encoding = dyn_cast<MDNode>(Op);
+        if (!Encoding || Encoding->getNumOperands() < 2)
+          continue;
+        ConstantInt *CalleeNo =
+          mdconst::dyn_extract_or_null<ConstantInt>(Encoding->getOperand(0));
+        if (!CalleeNo || CalleeNo->getSExtValue() != int64_t(OpNo))
+          continue;
+        ArgMap.clear();
+        for (unsigned i = 1, e = Encoding->getNumOperands() - 1; i < e; ++i) {
+          ConstantInt *ArgNo =
+            mdconst::dyn_extract_or_null<ConstantInt>(Encoding->getOperand(i));
+          ArgMap.push_back(ArgNo ? int(ArgNo->getSExtValue()) : -1);
+        }
+        return true;
+      }
+      return false;
+    }
+
+    if (!Broker->isDeclaration())
+      return false;
+    for (const BrokerInfo &B : KnownBrokers)
+      if (Broker->getName() == B.Name && unsigned(B.CalleeNo) == OpNo) {
+        ArgMap.assign(B.Args, B.Args + B.NumArgs);
+        return true;
+      }
+    return false;
+  }
+
+  /// AllocaForwarding - Store-to-load forwarding for the allocas of one
+  /// function whose address never escapes, i.e. that are only used as the
+  /// pointer of simple loads and stores (every local at -O0). For each load
+  /// of such an alloca it finds the store the load must read: the closest
+  /// earlier store in its block, else the store reaching the end of its
+  /// chain of unique predecessors, else the alloca's only store when that
+  /// store sits in the entry block. Loads without such a store are left
+  /// alone.
+  class AllocaForwarding {
+    std::set<const AllocaInst*> Tracked;
+    std::map<LoadInst*, StoreInst*> Reaching;
+    std::map<StoreInst*, std::vector<LoadInst*>> Readers;
+    std::map<const AllocaInst*, StoreInst*> OnlyEntryStore;
+
+  public:
+    explicit AllocaForwarding(Function &F) {
+      std::map<const AllocaInst*, unsigned> NumStores;
+      for (Instruction &I : F.getEntryBlock())
+        if (AllocaInst *AI = dyn_cast<AllocaInst>(&I))
+          if (isForwardableAlloca(AI))
+            Tracked.insert(AI);
+      if (Tracked.empty())
+        return;
+
+      for (BasicBlock &BB : F)
+        for (Instruction &I : BB)
+          if (StoreInst *SI = dyn_cast<StoreInst>(&I))
+            if (AllocaInst *AI = getTrackedAlloca(SI->getPointerOperand()))
+              if (++NumStores[AI] == 1 && &BB == &F.getEntryBlock())
+                OnlyEntryStore[AI] = SI;
+      for (auto &Entry : NumStores)
+        if (Entry.second != 1)
+          OnlyEntryStore.erase(Entry.first);
+
+      for (BasicBlock &BB : F) {
+        std::map<AllocaInst*, StoreInst*> Last;
+        for (Instruction &I : BB) {
+          if (StoreInst *SI = dyn_cast<StoreInst>(&I)) {
+            if (AllocaInst *AI = getTrackedAlloca(SI->getPointerOperand()))
+              Last[AI] = SI;
+            continue;
+          }
+          LoadInst *LI = dyn_cast<LoadInst>(&I);
+          if (!LI)
+            continue;
+          AllocaInst *AI = getTrackedAlloca(LI->getPointerOperand());
+          if (!AI)
+            continue;
+
+          StoreInst *SI = Last.count(AI) ? Last[AI]
+                                         : findStoreIntoBlock(&BB, AI);
+          if (!SI || SI->getValueOperand()->getType() != LI->getType())
+            continue;
+          Reaching[LI] = SI;
+          Readers[SI].push_back(LI);
+        }
+      }
+    }
+
+    bool tracks(const Value *Ptr) const {
+      const AllocaInst *AI = dyn_cast<AllocaInst>(Ptr);
+      return AI && Tracked.count(AI);
+    }
+
+    StoreInst *getReachingStore(LoadInst *LI) const {
+      std::map<LoadInst*, StoreInst*>::const_iterator I = Reaching.find(LI);
+      return I == Reaching.end() ? nullptr : I->second;
+    }
+
+    /// getReaders - The loads that read the value SI stores, or null.
+    const std::vector<LoadInst*> *getReaders(StoreInst *SI) const {
+      std::map<StoreInst*, std::vector<LoadInst*>>::const_iterator I =
+        Readers.find(SI);
+      return I == Readers.end() ? nullptr : &I->second;
+    }
+
+    static bool isForwardableAlloca(const AllocaInst *AI) {
+      for (const User *U : AI->users()) {
+        if (const LoadInst *LI = dyn_cast<LoadInst>(U)) {
+          if (!LI->isSimple())
+            return false;
+        } else if (const StoreInst *SI = dyn_cast<StoreInst>(U)) {
+          if (!SI->isSimple() || SI->getValueOperand() == AI)
+            return false;
+        } else {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    /// forwardedValue - Look through loads of non-escaping allocas to the
+    /// value that was stored, without building the whole model. Used for
+    /// the actual arguments of a call site.
+    static Value *forwardedValue(Value *V) {
+      while (LoadInst *LI = dyn_cast<LoadInst>(V)) {
+        AllocaInst *AI = dyn_cast<AllocaInst>(LI->getPointerOperand());
+        if (!AI || !LI->isSimple() || !isForwardableAlloca(AI))
+          break;
+
+        StoreInst *SI = nullptr;
+        for (BasicBlock::iterator I = LI->getIterator(),
+             B = LI->getParent()->begin(); I != B && !SI;) {
+          StoreInst *Prev = dyn_cast<StoreInst>(&*--I);
+          if (Prev && Prev->getPointerOperand() == AI)
+            SI = Prev;
+        }
+        if (!SI)
+          SI = findStoreOnPredecessorChain(LI->getParent(), AI);
+        if (!SI)
+          SI = findOnlyEntryStore(AI, LI);
+        if (!SI || SI->getValueOperand()->getType() != LI->getType())
+          break;
+        V = SI->getValueOperand();
+      }
+      return V;
+    }
+
+  private:
+    AllocaInst *getTrackedAlloca(Value *Ptr) const {
+      AllocaInst *AI = dyn_cast<AllocaInst>(Ptr);
+      return AI && Tracked.count(AI) ? AI : nullptr;
+    }
+
+    // findStoreIntoBlock - The last store to AI on the chain of unique
+    // predecessors leading into BB.
+    StoreInst *findStoreIntoBlock(BasicBlock *BB, AllocaInst *AI) const {
+      if (StoreInst *SI = findStoreOnPredecessorChain(BB, AI))
+        return SI;
+      std::map<const AllocaInst*, StoreInst*>::const_iterator I =
+        OnlyEntryStore.find(AI);
+      if (I == OnlyEntryStore.end() || BB == I->second->getParent())
+        return nullptr;
+      return I->second;
+    }
+
+    static StoreInst *findStoreOnPredecessorChain(BasicBlock *BB,
+                                                  AllocaInst *AI) {
+      std::set<BasicBlock*> Visited;
+      Visited.insert(BB);
+      for (BasicBlock *Pred = BB->getSinglePredecessor();
+           Pred && Visited.insert(Pred).second;
+           Pred = Pred->getSinglePredecessor())
+        for (BasicBlock::reverse_iterator I = Pred->rbegin(),
+             E = Pred->rend(); I != E; ++I)
+          if (StoreInst *SI = dyn_cast<StoreInst>(&*I))
+            if (SI->getPointerOperand() == AI)
+              return SI;
+      return nullptr;
+    }
+
+    static StoreInst *findOnlyEntryStore(AllocaInst *AI, LoadInst *LI) {
+      StoreInst *Only = nullptr;
+      for (User *U : AI->users())
+        if (StoreInst *SI = dyn_cast<StoreInst>(U)) {
+          if (Only)
+            return nullptr;
+          Only = SI;
+        }
+      BasicBlock *Entry = &AI->getParent()->getParent()->getEntryBlock();
+      if (!Only || Only->getParent() != Entry || LI->getParent() == Entry)
+        return nullptr;
+      return Only;
+    }
+  };
+
+  /// FunctionSolver - Optimistic constant propagation over one function that
+  /// tracks which CFG edges can execute. Values are only evaluated in blocks
+  /// reachable through feasible edges, and a conditional branch or switch on
+  /// known constants only makes the successors they select feasible.
+  ///
+  /// Formals and the results of calls are looked up in the interprocedural
+  /// argument and return states when given; anything missing from them is
+  /// overdefined. Loads of non-escaping allocas take the value of the store
+  /// AllocaForwarding finds for them, so -O0 code needs no mem2reg first.
+  /// Loads of a tracked internal global take the global's state: its
+  /// initializer met with everything stored to it anywhere in the module.
+  /// Fields of struct values are followed separately through insertvalue
+  /// chains and per-field return states, so that one unknown field does not
+  /// hide the others from an extractvalue.
+  class FunctionSolver {
+    const DataLayout &DL;
+    const TargetLibraryInfo *TLI;
+    const ArgStateMap *ArgStates;
+    const ReturnStateMap *ReturnStates;
+    const GlobalStateMap *GlobalStates;
+    const FieldStateMap *ReturnFieldStates;
+
+    std::map<Value*, LatticeVal> ValueState;
+    std::set<BasicBlock*> BBExecutable;
+    std::set<std::pair<BasicBlock*, BasicBlock*>> KnownFeasibleEdges;
+
+    std::vector<BasicBlock*> BBWorkList;
+    std::vector<Instruction*> InstWorkList;
+    std::unique_ptr<AllocaForwarding> Forwarding;
+
+  public:
+    FunctionSolver(const DataLayout &DL, const TargetLibraryInfo *TLI,
+                   const ArgStateMap *ArgStates = nullptr,
+                   const ReturnStateMap *ReturnStates = nullptr,
+                   const GlobalStateMap *GlobalStates = nullptr,
+                   const FieldStateMap *ReturnFieldStates = nullptr)
+      : DL(DL), TLI(TLI), ArgStates(ArgStates), ReturnStates(ReturnStates),
+        GlobalStates(GlobalStates), ReturnFieldStates(ReturnFieldStates) {}
+
+    /// solve - Run to a fixed point. Unless ResolveUndefs is false, values
+    /// left undefined afterwards are forced overdefined so the result can be
+    /// committed; the interprocedural solver keeps them undefined until all
+    /// callers have been seen.
+    void solve(Function &F, bool ResolveUndefs = true) {
+      Forwarding.reset(new AllocaForwarding(F));
+      markBlockExecutable(&F.front());
+      propagate();
+      while (ResolveUndefs && resolveUndefs(F))
+        propagate();
+    }
+
+    bool isBlockExecutable(BasicBlock *BB) const {
+      return BBExecutable.count(BB);
+    }
+
+    LatticeVal getValueState(Value *V) {
+      if (Constant *C = dyn_cast<Constant>(V))
+        return LatticeVal::get(C);
+      if (Argument *A = dyn_cast<Argument>(V)) {
+        if (ArgStates) {
+          ArgStateMap::const_iterator I = ArgStates->find(A);
+          if (I != ArgStates->end())
+            return I->second;
+        }
+        return LatticeVal::getOverdefined();
+      }
+      if (!isa<Instruction>(V))
+        return LatticeVal::getOverdefined();
+      std::map<Value*, LatticeVal>::iterator I = ValueState.find(V);
+      if (I == ValueState.end())
+        return LatticeVal();
+      return I->second;
+    }
+
+    /// getFieldState - The state of field Idx of the struct value V: the
+    /// value last inserted there, the callee's return state for the field,
+    /// or else the field of each constant V can be.
+    LatticeVal getFieldState(Value *V, unsigned Idx) {
+      while (InsertValueInst *IVI = dyn_cast<InsertValueInst>(V)) {
+        ArrayRef<unsigned> Idxs = IVI->getIndices();
+        if (Idxs[0] != Idx) {
+          V = IVI->getAggregateOperand();
+          continue;
+        }
+        if (Idxs.size() == 1)
+          return getValueState(IVI->getInsertedValueOperand());
+        break;
+      }
+      if (CallSite CS = CallSite(V))
+        if (Function *Callee = CS.getCalledFunction())
+          if (ReturnFieldStates) {
+            FieldStateMap::const_iterator I =
+              ReturnFieldStates->find(std::make_pair(Callee, Idx));
+            if (I != ReturnFieldStates->end())
+              return I->second;
+          }
+
+      LatticeVal Agg = getValueState(V);
+      if (!Agg.isConstantSet())
+        return Agg;
+      LatticeVal Result;
+      for (Constant *C : Agg.Values) {
+        Constant *Elt = C->getAggregateElement(Idx);
+        if (!Elt)
+          return LatticeVal::getOverdefined();
+        Result.insert(Elt);
+      }
+      return Result;
+    }
+
+  private:
+    void propagate() {
+      while (!BBWorkList.empty() || !InstWorkList.empty()) {
+        while (!InstWorkList.empty()) {
+          Instruction *I = InstWorkList.back();
+          InstWorkList.pop_back();
+          // Blocks that are not executable yet are visited in full once
+          // they become executable.
+          if (isBlockExecutable(I->getParent()))
+            visit(I);
+        }
+
+        while (!BBWorkList.empty()) {
+          BasicBlock *BB = BBWorkList.back();
+          BBWorkList.pop_back();
+          for (Instruction &I : *BB)
+            visit(&I);
+        }
+      }
+    }
+
+    // resolveUndefs - Anything executable that is still undefined once the
+    // worklists drain depends on itself only; give it up as overdefined (and
+    // let branches on it go both ways) so that nothing is folded unsoundly.
+    bool resolveUndefs(Function &F) {
+      bool Changed = false;
+      for (BasicBlock &BB : F) {
+        if (!isBlockExecutable(&BB))
+          continue;
+        for (Instruction &I : BB) {
+          if (TerminatorInst *TI = dyn_cast<TerminatorInst>(&I)) {
+            Value *Cond = nullptr;
+            if (BranchInst *BI = dyn_cast<BranchInst>(TI)) {
+              if (BI->isConditional())
+                Cond = BI->getCondition();
+            } else if (SwitchInst *SI = dyn_cast<SwitchInst>(TI)) {
+              Cond = SI->getCondition();
+            }
+            if (Cond && getValueState(Cond).isUndefined())
+              for (unsigned i = 0, e = TI->getNumSuccessors(); i != e; ++i)
+                Changed |= markEdgeExecutable(&BB, TI->getSuccessor(i));
+          }
+          // Including the result of an invoke.
+          if (!I.getType()->isVoidTy() && getValueState(&I).isUndefined()) {
+            updateState(&I, LatticeVal::getOverdefined());
+            Changed = true;
+          }
+        }
+      }
+      return Changed;
+    }
+
+    void markBlockExecutable(BasicBlock *BB) {
+      if (BBExecutable.insert(BB).second)
+        BBWorkList.push_back(BB);
+    }
+
+    bool markEdgeExecutable(BasicBlock *From, BasicBlock *To) {
+      if (!KnownFeasibleEdges.insert(std::make_pair(From, To)).second)
+        return false;
+
+      if (!isBlockExecutable(To)) {
+        markBlockExecutable(To);
+      } else {
+        // A new edge into a live block can only change its PHIs.
+        for (BasicBlock::iterator I = To->begin(); isa<PHINode>(I); ++I)
+          InstWorkList.push_back(&*I);
+      }
+      return true;
+    }
+
+    void updateState(Instruction *I, const LatticeVal &V) {
+      if (!ValueState[I].mergeIn(V))
+        return;
+      for (User *U : I->users()) {
+        Instruction *UI = dyn_cast<Instruction>(U);
+        if (!UI)
+          continue;
+        InstWorkList.push_back(UI);
+        // Stored into a tracked alloca: the loads it reaches change too.
+        if (StoreInst *SI = dyn_cast<StoreInst>(UI))
+          if (const std::vector<LoadInst*> *Loads =
+                Forwarding->getReaders(SI))
+            InstWorkList.insert(InstWorkList.end(), Loads->begin(),
+                                Loads->end());
+      }
+    }
+
+    void visit(Instruction *I) {
+      if (PHINode *PN = dyn_cast<PHINode>(I))
+        return visitPHINode(PN);
+      if (TerminatorInst *TI = dyn_cast<TerminatorInst>(I)) {
+        if (InvokeInst *II = dyn_cast<InvokeInst>(TI))
+          if (!II->getType()->isVoidTy())
+            visitInvokeResult(II);
+        return visitTerminator(TI);
+      }
+      if (I->getType()->isVoidTy())
+        return;
+      // Extractvalues read single fields of an insertvalue chain, which can
+      // change while the aggregate as a whole stays overdefined.
+      if (isa<InsertValueInst>(I))
+        for (User *U : I->users())
+          if (isa<ExtractValueInst>(U) || isa<InsertValueInst>(U))
+            InstWorkList.push_back(cast<Instruction>(U));
+      if (getValueState(I).isOverdefined())
+        return;
+      if (SelectInst *SI = dyn_cast<SelectInst>(I))
+        return visitSelect(SI);
+      if (ExtractValueInst *EVI = dyn_cast<ExtractValueInst>(I))
+        if (EVI->getNumIndices() == 1 &&
+            EVI->getAggregateOperand()->getType()->isStructTy())
+          return updateState(I, getFieldState(EVI->getAggregateOperand(),
+                                              EVI->getIndices()[0]));
+
+      if (!isa<BinaryOperator>(I) && !isa<CastInst>(I) && !isa<CmpInst>(I) &&
+          !isa<GetElementPtrInst>(I) && !isa<LoadInst>(I) &&
+          !isa<CallInst>(I) && !isa<ExtractValueInst>(I) &&
+          !isa<InsertValueInst>(I) && !isa<ExtractElementInst>(I) &&
+          !isa<InsertElementInst>(I))
+        return updateState(I, LatticeVal::getOverdefined());
+
+      // Gather the operand states, waiting while any of them is unknown.
+      SmallVector<LatticeVal, 4> Ops;
+      if (CallInst *CI = dyn_cast<CallInst>(I)) {
+        Function *Callee = CI->getCalledFunction();
+        if (Callee && ReturnStates) {
+          ReturnStateMap::const_iterator RI = ReturnStates->find(Callee);
+          if (RI != ReturnStates->end())
+            return updateState(I, RI->second);
+        }
+        if (!Callee || !canConstantFoldCallTo(Callee))
+          return updateState(I, LatticeVal::getOverdefined());
+        CallSite CS(CI);
+        for (CallSite::arg_iterator AI = CS.arg_begin(), AE = CS.arg_end();
+             AI != AE; ++AI)
+          if (!addOperand(*AI, Ops, I))
+            return;
+      } else {
+        if (LoadInst *LI = dyn_cast<LoadInst>(I)) {
+          GlobalVariable *GV = dyn_cast<GlobalVariable>(LI->getPointerOperand());
+          if (GV && GlobalStates) {
+            GlobalStateMap::const_iterator GI = GlobalStates->find(GV);
+            if (GI != GlobalStates->end())
+              return updateState(I, GI->second);
+          }
+          if (StoreInst *SI = Forwarding->getReachingStore(LI))
+            return updateState(I, getValueState(SI->getValueOperand()));
+          if (LI->isVolatile())
+            return updateState(I, LatticeVal::getOverdefined());
+        }
+        for (Use &Op : I->operands())
+          if (!addOperand(Op.get(), Ops, I))
+            return;
+      }
+
+      // Fold every combination of the operands' constants. Give up when
+      // there are too many combinations to stay within the set bound anyway.
+      unsigned NumCombinations = 1;
+      for (const LatticeVal &Op : Ops) {
+        NumCombinations *= Op.Values.size();
+        if (NumCombinations > MaxArgConstants * MaxArgConstants)
+          return updateState(I, LatticeVal::getOverdefined());
+      }
+
+      LatticeVal Result;
+      SmallVector<Constant*, 8> Combination(Ops.size());
+      for (unsigned n = 0; n != NumCombinations; ++n) {
+        unsigned Rest = n;
+        for (unsigned i = 0, e = Ops.size(); i != e; ++i) {
+          Combination[i] = Ops[i].Values[Rest % Ops[i].Values.size()];
+          Rest /= Ops[i].Values.size();
+        }
+        Constant *C = foldOperands(I, Combination);
+        if (!C)
+          return updateState(I, LatticeVal::getOverdefined());
+        Result.insert(C);
+        if (Result.isOverdefined())
+          break;
+      }
+      updateState(I, Result);
+    }
+
+    // addOperand - Append the state of V to Ops. Returns false if the
+    // instruction cannot be evaluated now, marking it overdefined when V is.
+    bool addOperand(Value *V, SmallVectorImpl<LatticeVal> &Ops,
+                    Instruction *I) {
+      LatticeVal OpV = getValueState(V);
+      if (OpV.isOverdefined()) {
+        updateState(I, LatticeVal::getOverdefined());
+        return false;
+      }
+      if (OpV.isUndefined())
+        return false;
+      Ops.push_back(OpV);
+      return true;
+    }
+
+    Constant *foldOperands(Instruction *I, ArrayRef<Constant*> Ops) {
+      if (CmpInst *CI = dyn_cast<CmpInst>(I))
+        return ConstantFoldCompareInstOperands(CI->getPredicate(), Ops[0],
+                                               Ops[1], DL, TLI);
+      if (LoadInst *LI = dyn_cast<LoadInst>(I))
+        return ConstantFoldLoadFromConstPtr(Ops[0], LI->getType(), DL);
+      if (CallInst *CI = dyn_cast<CallInst>(I))
+        return ConstantFoldCall(CI->getCalledFunction(), Ops, TLI);
+      if (GetElementPtrInst *GEP = dyn_cast<GetElementPtrInst>(I))
+        return ConstantExpr::getGetElementPtr(GEP->getSourceElementType(),
+                                              Ops[0], Ops.slice(1));
+      if (ExtractValueInst *EVI = dyn_cast<ExtractValueInst>(I))
+        return ConstantExpr::getExtractValue(Ops[0], EVI->getIndices());
+      if (InsertValueInst *IVI = dyn_cast<InsertValueInst>(I))
+        return ConstantExpr::getInsertValue(Ops[0], Ops[1], IVI->getIndices());
+      return ConstantFoldInstOperands(I->getOpcode(), I->getType(), Ops, DL,
+                                      TLI);
+    }
+
+    void visitSelect(SelectInst *SI) {
+      LatticeVal CondV = getValueState(SI->getCondition());
+      if (CondV.isUndefined())
+        return;
+
+      LatticeVal Result;
+      bool TrueArm = CondV.isOverdefined(), FalseArm = CondV.isOverdefined();
+      for (Constant *C : CondV.Values) {
+        ConstantInt *CI = dyn_cast<ConstantInt>(C);
+        TrueArm |= !CI || !CI->isZero();
+        FalseArm |= !CI || CI->isZero();
+      }
+      if (TrueArm)
+        Result.mergeIn(getValueState(SI->getTrueValue()));
+      if (FalseArm)
+        Result.mergeIn(getValueState(SI->getFalseValue()));
+      updateState(SI, Result);
+    }
+
+    void visitPHINode(PHINode *PN) {
+      LatticeVal Result;
+      for (unsigned i = 0, e = PN->getNumIncomingValues(); i != e; ++i) {
+        if (!KnownFeasibleEdges.count(std::make_pair(PN->getIncomingBlock(i),
+                                                     PN->getParent())))
+          continue;
+        Result.mergeIn(getValueState(PN->getIncomingValue(i)));
+        if (Result.isOverdefined())
+          break;
+      }
+      updateState(PN, Result);
+    }
+
+    // visitInvokeResult - What an invoke returns on its normal edge: the
+    // return state of a tracked callee, or anything at all.
+    void visitInvokeResult(InvokeInst *II) {
+      if (Function *Callee = II->getCalledFunction())
+        if (ReturnStates) {
+          ReturnStateMap::const_iterator RI = ReturnStates->find(Callee);
+          if (RI != ReturnStates->end())
+            return updateState(II, RI->second);
+        }
+      updateState(II, LatticeVal::getOverdefined());
+    }
+
+    void visitTerminator(TerminatorInst *TI) {
+      BasicBlock *BB = TI->getParent();
+
+      if (BranchInst *BI = dyn_cast<BranchInst>(TI)) {
+        if (BI->isConditional()) {
+          LatticeVal CondV = getValueState(BI->getCondition());
+          if (CondV.isUndefined())
+            return;
+          if (CondV.isConstantSet()) {
+            for (Constant *C : CondV.Values) {
+              ConstantInt *CI = dyn_cast<ConstantInt>(C);
+              if (!CI || !CI->isZero())
+                markEdgeExecutable(BB, BI->getSuccessor(0));
+              if (!CI || CI->isZero())
+                markEdgeExecutable(BB, BI->getSuccessor(1));
+            }
+            return;
+          }
+        }
+      } else if (SwitchInst *SI = dyn_cast<SwitchInst>(TI)) {
+        LatticeVal CondV = getValueState(SI->getCondition());
+        if (CondV.isUndefined())
+          return;
+        if (CondV.isConstantSet() && allConstantInts(CondV)) {
+          for (Constant *C : CondV.Values)
+            markEdgeExecutable(BB, SI->findCaseValue(cast<ConstantInt>(C))
+                                     .getCaseSuccessor());
+          return;
+        }
+      }
+
+      for (unsigned i = 0, e = TI->getNumSuccessors(); i != e; ++i)
+        markEdgeExecutable(BB, TI->getSuccessor(i));
+    }
+
+  public:
+    static bool allConstantInts(const LatticeVal &V) {
+      for (Constant *C : V.Values)
+        if (!isa<ConstantInt>(C))
+          return false;
+      return true;
+    }
+  };
+}
+
+namespace {
+  // Hello - The interprocedural constant propagation pass.
+  struct Hello : public ModulePass {
+    static char ID; // Pass identification, replacement for typeid
+    Hello() : ModulePass(ID) {}
+    
+    private:
+     std::map <llvm::Argument*,std::vector<llvm::Argument*>> consumerSet;
+     // Functions whose body was rewritten by propagation; only these get
+     // the cleanup pipeline.
+     std::set<llvm::Function*> dirtyFunctions;
+     // Formals that isFormalParamConstant replaced with a constant.
+     std::set<llvm::Argument*> constantArgs;
+     // Solved constant sets of the formals and returns of internal functions.
+     ArgStateMap argStates;
+     ReturnStateMap returnStates;
+     GlobalStateMap globalStates;
+     FieldStateMap returnFieldStates;
+     // Pointer formals whose pointee is only ever read, here or further
+     // down the calls they are passed to.
+     std::set<llvm::Argument*> readOnlyArgs;
+     // Constant contents of the allocas and globals passed to them, and the
+     // private constant globals that stand in for them.
+     std::map<llvm::AllocaInst*, llvm::Constant*> allocaImages;
+     std::map<llvm::Constant*, llvm::GlobalVariable*> imageGlobals;
+     // Clones made for a function and the constants they were made for.
+     std::map<std::pair<llvm::Function*, std::vector<llvm::Constant*>>,
+              llvm::Function*> specializations;
+     // Internal functions reached through a call other than as its direct
+     // callee: via a function pointer traced to it, or via a broker.
+     std::map<llvm::Instruction*, std::vector<CallEdge>> indirectCallees;
+     // Per-function work, kept only under -hello-function-costs. Keyed by
+     // name, since functions are replaced while the pass runs.
+     StringMap<FunctionCost> functionCosts;
+     // Whether this run emits remarks, and where their YAML goes.
+     bool remarksEnabled = false;
+     std::unique_ptr<raw_fd_ostream> remarksFile;
+     // Formals a missed remark was already emitted for.
+     std::set<llvm::Argument*> missedReported;
+     // The compile-time budget, the phase that ran it out, and what was
+     // left undone because of it.
+     CompileBudget budget;
+     const char *currentPhase = nullptr;
+     const char *exhaustedIn = nullptr;
+     std::vector<const char*> skippedPhases;
+     unsigned skippedConsumerFunctions = 0;
+     unsigned skippedFormals = 0;
+     unsigned skippedSolves = 0;
+     unsigned skippedFolds = 0;
+
+     // spend - Account for Units of work against the budget; false once it
+     // is gone.
+     bool spend(unsigned Units = 1) {
+       if (budget.spend(Units))
+         return true;
+       if (!exhaustedIn) {
+         exhaustedIn = currentPhase;
+         ++NumBudgetExhausted;
+       }
+       return false;
+     }
+
+     // getCost - Where the work done for F is counted, or null when it is
+     // not being counted.
+     FunctionCost *getCost(const Function *F) {
+       if (!HelloFunctionCosts)
+         return nullptr;
+       return &functionCosts[F->getName()];
+     }
+    // emitRemark - Report R to the diagnostic handler and the remarks file.
+    // Callers check remarksEnabled before building R.
+    void emitRemark(const Remark &R) {
+      std::string Msg = R.getMessage();
+      if (R.Passed)
+        emitOptimizationRemark(R.Fn.getContext(), DEBUG_TYPE, R.Fn, R.Loc,
+                               Msg);
+      else
+        emitOptimizationRemarkMissed(R.Fn.getContext(), DEBUG_TYPE, R.Fn,
+                                     R.Loc, Msg);
+      if (remarksFile)
+        writeRemarkYAML(*remarksFile, R);
+    }
+
+    void remarkConstantArgument(Argument *A, Value *V) {
+      if (!remarksEnabled)
+        return;
+      Remark R(true, "ConstantArgument", *A->getParent());
+      R.arg("Argument", A) << " of ";
+      R.arg("Callee", A->getParent()) << " is always ";
+      emitRemark(R.arg("Constant", V));
+    }
+
+    void remarkMissedArgument(Argument *A, StringRef Reason) {
+      if (!remarksEnabled || !missedReported.insert(A).second)
+        return;
+      Remark R(false, "NotConstant", *A->getParent());
+      R.arg("Argument", A) << " of ";
+      R.arg("Callee", A->getParent()) << " is not constant: ";
+      emitRemark(R << Reason);
+    }
+    public:
+    
+
+    void getAnalysisUsage(AnalysisUsage &AU) const override {
+      AU.addRequired<TargetLibraryInfoWrapperPass>();
+      // Block frequencies only scale entry counts into call counts.
+      if (HelloProfile)
+        AU.addRequired<BlockFrequencyInfoWrapperPass>();
+    }
+
+
+    bool runOnModule(Module &M) override {
+      // The pass object may be run over several modules; nothing keyed by
+      // the last one's values may survive into this run.
+      consumerSet.clear();
+      dirtyFunctions.clear();
+      constantArgs.clear();
+      specializations.clear();
+      LastRunPhaseTimes.clear();
+      functionCosts.clear();
+      missedReported.clear();
+      remarksFile.reset();
+      if (!HelloRemarksOutput.empty()) {
+        std::error_code EC;
+        remarksFile.reset(new raw_fd_ostream(HelloRemarksOutput, EC,
+                                             sys::fs::F_Text));
+        if (EC) {
+          errs() << "hello: " << HelloRemarksOutput << ": " << EC.message()
+                 << '\n';
+          remarksFile.reset();
+        }
+      }
+      remarksEnabled = remarksFile || areRemarksRequested(M);
+      budget.start(HelloBudgetWork, HelloBudgetMs);
+      exhaustedIn = nullptr;
+      skippedPhases.clear();
+      skippedConsumerFunctions = skippedFormals = 0;
+      skippedSolves = skippedFolds = 0;
+      if (!HelloTrace.empty())
+        HelloTraceWriter->open(HelloTrace);
+
+      // Both run on the formals as the source declares them, so that the
+      // profile one compile writes matches what the next one reads.
+      bool Changed = false;
+      runPhase("value-profile", [&] {
+        if (!HelloValueProfileUse.empty())
+          applyValueProfile(M);
+        if (!HelloValueProfileGen.empty())
+          Changed |= instrumentValueProfile(M);
+      });
+
+      // Past the budget, the phases that only find more are skipped. The
+      // constant-set solver instead finishes pessimistically, since its
+      // optimistic facts are only final at its fixed point.
+      runBudgetedPhase("consumer-sets", [&] {
+        findIndirectCallees(M);
+        initConsumerSets(M);
+        indirectCallees.clear();
+      });
+      runBudgetedPhase("ipconstprop", [&] { ipConstantProp(M); });
+      runBudgetedPhase("constant-sets", [&] {
+        computeConstantSets(M);
+        indirectCallees.clear();
+      });
+      runPhase("commit", [&] { commitConstantSets(M); });
+      runBudgetedPhase("arg-facts", [&] {
+        propagateArgFacts(M);
+        indirectCallees.clear();
+      });
+      runBudgetedPhase("specialize", [&] {
+        specializeFunctions(M);
+        specializeContexts(M);
+      });
+      argStates.clear();
+      returnStates.clear();
+      globalStates.clear();
+      returnFieldStates.clear();
+      allocaImages.clear();
+      removeDeadImages();
+      runBudgetedPhase("dead-args", [&] { removeDeadArguments(M); });
+      runBudgetedPhase("cleanup", [&] { cleanupDirtyFunctions(M); });
+
+      if (exhaustedIn)
+        printBudgetReport(M);
+      if (!HelloTimeReport.empty())
+        printPhaseReport(M);
+      if (HelloFunctionCosts)
+        printFunctionCosts(errs(), functionCosts, HelloFunctionCosts);
+      HelloTraceWriter->close();
+      remarksFile.reset();
+      return Changed || !dirtyFunctions.empty();
+    }
+
+    // runPhase - Run one phase of the pass, recording its time and memory.
+    template <typename PhaseFn>
+    void runPhase(const char *Name, PhaseFn Phase) {
+      PhaseScope Scope(Name);
+      TraceSpan Span(Name, "phase");
+      currentPhase = Name;
+      Phase();
+    }
+
+    // runBudgetedPhase - Run a phase unless the budget is already gone.
+    template <typename PhaseFn>
+    void runBudgetedPhase(const char *Name, PhaseFn Phase) {
+      if (budget.isExhausted())
+        skippedPhases.push_back(Name);
+      else
+        runPhase(Name, Phase);
+    }
+
+    // printBudgetReport - Say where the budget ran out and what was left
+    // undone because of it.
+    void printBudgetReport(Module &M) {
+      errs() << "hello: compile-time budget exhausted in " << exhaustedIn
+             << " of " << M.getModuleIdentifier() << " after "
+             << budget.getWork() << " work units and "
+             << format("%.1f", budget.getElapsedMillis()) << " ms\n";
+      if (skippedConsumerFunctions)
+        errs() << "  consumers not found for " << skippedConsumerFunctions
+               << " functions\n";
+      if (skippedFormals)
+        errs() << "  " << skippedFormals
+               << " formals left on the ipconstprop worklist\n";
+      if (skippedSolves)
+        errs() << "  " << skippedSolves
+               << " constant-set solves given up, their facts overdefined\n";
+      if (skippedFolds)
+        errs() << "  " << skippedFolds << " functions not folded\n";
+      if (!skippedPhases.empty()) {
+        errs() << "  skipped phases:";
+        for (const char *Phase : skippedPhases)
+          errs() << ' ' << Phase;
+        errs() << '\n';
+      }
+    }
+
+    // Run the usual post-propagation cleanup (dead compares, folded branches,
+    // dead argument computations) on the changed functions only, instead of
+    // making the user run -instcombine -simplifycfg -dce over the module.
+    void cleanupDirtyFunctions(Module &M) {
+      if (!HelloCleanup || dirtyFunctions.empty())
+        return;
+
+      legacy::FunctionPassManager FPM(&M);
+      FPM.add(createInstructionCombiningPass());
+      FPM.add(createCFGSimplificationPass());
+      FPM.add(createDeadCodeEliminationPass());
+
+      FPM.doInitialization();
+      for (Function *F : dirtyFunctions) {
+        if (F->isDeclaration())
+          continue;
+        FPM.run(*F);
+        ++NumFunctionsCleaned;
+      }
+      FPM.doFinalization();
+    }
+
+    // collectDirectCallSites - If every use of F is the callee of a call or
+    // invoke, append those call sites to Sites and return true.
+    bool collectDirectCallSites(Function *F, std::vector<CallSite> &Sites) {
+      for (Use &U : F->uses()) {
+        User *UR = U.getUser();
+        if (!isa<CallInst>(UR) && !isa<InvokeInst>(UR))
+          return false;
+
+        CallSite CS(cast<Instruction>(UR));
+        if (!CS.isCallee(&U))
+          return false;
+        // A musttail call has to keep the caller's signature.
+        if (CS.isCall() && cast<CallInst>(UR)->isMustTailCall())
+          return false;
+        Sites.push_back(CS);
+      }
+      return true;
+    }
+
+    // getCallSites - Collect every call that can invoke F: its direct calls,
+    // or, for an internal function whose address is taken, the calls and
+    // broker calls that traceFunctionPointer follows its address to. Returns
+    // false when F can be reached some other way.
+    bool getCallSites(Function *F, std::vector<CallEdge> &Sites) {
+      std::vector<CallSite> Direct;
+      if (collectDirectCallSites(F, Direct)) {
+        for (CallSite &CS : Direct)
+          Sites.push_back(CallEdge(CS, F));
+        return true;
+      }
+      if (!F->hasLocalLinkage())
+        return false;
+      std::set<Value*> Visited;
+      return traceFunctionPointer(F, F, Sites, Visited);
+    }
+
+    // traceFunctionPointer - Follow where the address of F, held in V, can
+    // flow: through casts, PHIs and selects, into non-escaping locals and
+    // internal globals, and into the initializers of internal tables that
+    // are only ever indexed and loaded. Every call found calling through it
+    // with F's type is appended to Sites, as is every call handing it to a
+    // broker that will call it back; comparisons are harmless. Returns false
+    // if the address reaches anything else.
+    bool traceFunctionPointer(Function *F, Value *V,
+                              std::vector<CallEdge> &Sites,
+                              std::set<Value*> &Visited) {
+      if (!Visited.insert(V).second)
+        return true;
+
+      for (Use &U : V->uses()) {
+        User *UR = U.getUser();
+        if (isa<BlockAddress>(UR) || isa<ICmpInst>(UR))
+          continue;
+
+        if (isa<CallInst>(UR) || isa<InvokeInst>(UR)) {
+          CallSite CS(cast<Instruction>(UR));
+          if (!CS.isCallee(&U)) {
+            Function *Broker = CS.getCalledFunction();
+            std::vector<int> ArgMap;
+            if (!Broker || !CS.isArgOperand(&U) ||
+                !getBrokerArgMap(Broker, CS.getArgumentNo(&U), ArgMap))
+              return false;
+            Sites.push_back(CallEdge(CS, F, ArgMap));
+            continue;
+          }
+          Type *CalleeTy = CS.getCalledValue()->getType();
+          if (cast<PointerType>(CalleeTy)->getElementType() !=
+                F->getFunctionType())
+            return false;
+          Sites.push_back(CallEdge(CS, F));
+          continue;
+        }
+
+        bool Follow = false;
+        if (isa<BitCastInst>(UR) || isa<PHINode>(UR) || isa<SelectInst>(UR) ||
+            isa<GetElementPtrInst>(UR) || isa<ConstantArray>(UR) ||
+            isa<ConstantStruct>(UR)) {
+          Follow = true;
+        } else if (ConstantExpr *CE = dyn_cast<ConstantExpr>(UR)) {
+          Follow = CE->getOpcode() == Instruction::BitCast ||
+                   CE->getOpcode() == Instruction::GetElementPtr;
+          if (CE->getOpcode() == Instruction::ICmp)
+            continue;
+        } else if (GlobalVariable *GV = dyn_cast<GlobalVariable>(UR)) {
+          // V is (part of) the initializer of a table.
+          Follow = GV->hasLocalLinkage();
+        } else if (LoadInst *LI = dyn_cast<LoadInst>(UR)) {
+          // V points at a slot holding the address; the load yields it.
+          Follow = LI->getPointerOperand() == V;
+        } else if (StoreInst *SI = dyn_cast<StoreInst>(UR)) {
+          // Storing something else into the slot V points at is harmless.
+          if (SI->getPointerOperand() == V)
+            continue;
+          Value *Slot = SI->getPointerOperand();
+          AllocaInst *AI = dyn_cast<AllocaInst>(Slot);
+          GlobalVariable *GV = dyn_cast<GlobalVariable>(Slot);
+          if (AI && AllocaForwarding::isForwardableAlloca(AI))
+            UR = AI;
+          else if (GV && GV->hasLocalLinkage())
+            UR = GV;
+          else
+            return false;
+          Follow = true;
+        }
+
+        if (!Follow || !traceFunctionPointer(F, UR, Sites, Visited))
+          return false;
+      }
+      return true;
+    }
+
+    // findIndirectCallees - Map every call through a pointer, and every
+    // broker call, to the internal functions traceFunctionPointer followed
+    // the address of to it. The map goes stale as soon as calls are
+    // rewritten, so each phase reading it builds it afresh and clears it
+    // when done.
+    void findIndirectCallees(Module &M) {
+      indirectCallees.clear();
+      for (Function &F : M) {
+        if (!F.hasLocalLinkage() || F.isDeclaration())
+          continue;
+        std::vector<CallSite> Direct;
+        if (collectDirectCallSites(&F, Direct))
+          continue;
+        std::vector<CallEdge> Sites;
+        std::set<Value*> Visited;
+        if (!traceFunctionPointer(&F, &F, Sites, Visited))
+          continue;
+        for (CallEdge &E : Sites)
+          if (E.Broker || E.CS.getCalledFunction() != &F)
+            indirectCallees[E.CS.getInstruction()].push_back(E);
+      }
+    }
+
+    // getCallees - The functions a call can invoke as far as the pass
+    // knows: the direct callee, the traced targets of an indirect call and
+    // the callbacks handed to a broker.
+    std::vector<CallEdge> getCallees(CallSite CS) {
+      std::vector<CallEdge> Callees;
+      if (Function *Callee = CS.getCalledFunction())
+        Callees.push_back(CallEdge(CS, Callee));
+      std::map<Instruction*, std::vector<CallEdge>>::iterator I =
+        indirectCallees.find(CS.getInstruction());
+      if (I != indirectCallees.end())
+        Callees.insert(Callees.end(), I->second.begin(), I->second.end());
+      return Callees;
+    }
+
+    // rewriteCallSite - Replace the call CS with a call to NF that passes
+    // only the arguments marked in KeepArg, carrying their attributes over.
+    Instruction *rewriteCallSite(CallSite CS, Function *NF,
+                                 const std::vector<bool> &KeepArg) {
+      Instruction *Call = CS.getInstruction();
+      LLVMContext &Ctx = Call->getContext();
+      const AttributeSet &CallPAL = CS.getAttributes();
+
+      std::vector<Value*> Args;
+      SmallVector<AttributeSet, 8> AttributesVec;
+      if (CallPAL.hasAttributes(AttributeSet::ReturnIndex))
+        AttributesVec.push_back(AttributeSet::get(Ctx,
+                                                  CallPAL.getRetAttributes()));
+
+      CallSite::arg_iterator AI = CS.arg_begin();
+      for (unsigned i = 0, e = KeepArg.size(); i != e; ++i, ++AI) {
+        if (!KeepArg[i])
+          continue;
+        Args.push_back(*AI);
+        if (CallPAL.hasAttributes(i + 1)) {
+          AttrBuilder B(CallPAL, i + 1);
+          AttributesVec.push_back(AttributeSet::get(Ctx, Args.size(), B));
+        }
+      }
+
+      if (CallPAL.hasAttributes(AttributeSet::FunctionIndex))
+        AttributesVec.push_back(AttributeSet::get(Ctx,
+                                                  CallPAL.getFnAttributes()));
+      AttributeSet NewCallPAL = AttributeSet::get(Ctx, AttributesVec);
+
+      Instruction *New;
+      if (InvokeInst *II = dyn_cast<InvokeInst>(Call)) {
+        InvokeInst *NewII = InvokeInst::Create(NF, II->getNormalDest(),
+                                               II->getUnwindDest(), Args, "",
+                                               Call);
+        NewII->setCallingConv(CS.getCallingConv());
+        NewII->setAttributes(NewCallPAL);
+        New = NewII;
+      } else {
+        CallInst *NewCI = CallInst::Create(NF, Args, "", Call);
+        NewCI->setCallingConv(CS.getCallingConv());
+        NewCI->setAttributes(NewCallPAL);
+        if (cast<CallInst>(Call)->isTailCall())
+          NewCI->setTailCall();
+        New = NewCI;
+      }
+      New->setDebugLoc(Call->getDebugLoc());
+      New->setMetadata(LLVMContext::MD_prof,
+                       Call->getMetadata(LLVMContext::MD_prof));
+
+      if (!Call->use_empty())
+        Call->replaceAllUsesWith(New);
+      New->takeName(Call);
+      Call->eraseFromParent();
+      return New;
+    }
+
+    // removeDeadArguments - Drop the formals that propagation turned into
+    // constants from internal functions. Each function is rebuilt once with
+    // all of its dead formals removed, and every call site is rewritten in
+    // the same batch.
+    void removeDeadArguments(Module &M) {
+      if (!HelloDeadArgs || constantArgs.empty())
+        return;
+
+      std::map<llvm::Function*, std::vector<bool>> keepArgs;
+      for (llvm::Argument *A : constantArgs) {
+        Function *F = A->getParent();
+        if (!A->use_empty())
+          continue;
+        std::vector<bool> &Keep = keepArgs[F];
+        if (Keep.empty())
+          Keep.resize(F->arg_size(), true);
+        Keep[A->getArgNo()] = false;
+      }
+      constantArgs.clear();
+
+      for (auto &Entry : keepArgs) {
+        Function *F = Entry.first;
+        const std::vector<bool> &Keep = Entry.second;
+        if (!F->hasLocalLinkage() || F->isVarArg() || F->isDeclaration())
+          continue;
+
+        std::vector<CallSite> Sites;
+        if (!collectDirectCallSites(F, Sites))
+          continue;
+
+        // Build the new prototype and attribute list without the dead formals.
+        LLVMContext &Ctx = F->getContext();
+        FunctionType *FTy = F->getFunctionType();
+        const AttributeSet &PAL = F->getAttributes();
+        std::vector<Type*> Params;
+        SmallVector<AttributeSet, 8> AttributesVec;
+        if (PAL.hasAttributes(AttributeSet::ReturnIndex))
+          AttributesVec.push_back(AttributeSet::get(Ctx,
+                                                    PAL.getRetAttributes()));
+        for (unsigned i = 0, e = Keep.size(); i != e; ++i) {
+          if (!Keep[i])
+            continue;
+          Params.push_back(FTy->getParamType(i));
+          if (PAL.hasAttributes(i + 1)) {
+            AttrBuilder B(PAL, i + 1);
+            AttributesVec.push_back(AttributeSet::get(Ctx, Params.size(), B));
+          }
+        }
+        if (PAL.hasAttributes(AttributeSet::FunctionIndex))
+          AttributesVec.push_back(AttributeSet::get(Ctx,
+                                                    PAL.getFnAttributes()));
+
+        FunctionType *NFTy = FunctionType::get(FTy->getReturnType(), Params,
+                                               false);
+        Function *NF = Function::Create(NFTy, F->getLinkage());
+        NF->copyAttributesFrom(F);
+        NF->setAttributes(AttributeSet::get(Ctx, AttributesVec));
+        NF->setSubprogram(F->getSubprogram());
+        // copyAttributesFrom leaves the profile behind.
+        if (Optional<uint64_t> Count = F->getEntryCount())
+          NF->setEntryCount(*Count);
+        M.getFunctionList().insert(F->getIterator(), NF);
+        NF->takeName(F);
+
+        for (CallSite &CS : Sites) {
+          // The rewrite erases the old call.
+          dirtyFunctions.insert(CS.getCaller());
+          rewriteCallSite(CS, NF, Keep);
+        }
+
+        // Move the body over and rewire the surviving formals.
+        NF->getBasicBlockList().splice(NF->begin(), F->getBasicBlockList());
+        Function::arg_iterator NI = NF->arg_begin();
+        unsigned i = 0;
+        for (Function::arg_iterator I = F->arg_begin(), E = F->arg_end();
+             I != E; ++I, ++i) {
+          if (!Keep[i]) {
+            ++NumArgsRemoved;
+            continue;
+          }
+          I->replaceAllUsesWith(&*NI);
+          NI->takeName(&*I);
+          ++NI;
+        }
+
+        // F may have been recorded as a caller of itself above.
+        dirtyFunctions.erase(F);
+        dirtyFunctions.insert(NF);
+        F->eraseFromParent();
+      }
+    }
+
+    void ipConstantProp(Module &M) {
+      std::queue<llvm::Argument*> worklist;
+      // The formals in the queue. A formal many functions pass values to
+      // would otherwise be queued, and checked over all its calls, once
+      // for every constant found in them.
+      std::set<llvm::Argument*> queued;
+
+      // Initialize worklist queue with every formal param of every function
+      for(Module::iterator F=M.begin(), E=M.end(); F != E ; ++F){
+        Function::arg_iterator formal_param = F->arg_begin();
+        Function::arg_iterator FE = F->arg_end();
+
+        for(;formal_param != FE; ++formal_param){
+          worklist.push(formal_param);
+          queued.insert(formal_param);
+        }
+      }
+
+
+      llvm::Argument *current_formal_param;
+      bool isConstant = false;
+      while(!worklist.empty()) {
+        if (!spend()) {
+          skippedFormals += worklist.size();
+          break;
+        }
+        current_formal_param = worklist.front();
+        worklist.pop();
+        queued.erase(current_formal_param);
+        ++NumOfArgsPop;
+        if (isTracing())
+          HelloTraceWriter->sample("ipconstprop worklist", worklist.size());
+        FunctionCost *Cost = getCost(current_formal_param->getParent());
+        if (Cost)
+          ++Cost->Pops;
+        {
+          PhaseScope Scope("formal-check", isSubPhaseTimingEnabled());
+          CostTimer Timer(Cost);
+          isConstant = isFormalParamConstant(current_formal_param);
+        }
+        if (isConstant) {
+          ConstantPropagation(*(current_formal_param->getParent()));
+          ++NumConstantsProp;
+          for(auto &consumerParam : consumerSet[current_formal_param]) {
+            if (queued.insert(consumerParam).second)
+              worklist.push(consumerParam);
+          }
+        }
+      }
+    }
+    
+    // computeConstantSets - Solve the bounded constant-set lattice over the
+    // module. Each function is solved with FunctionSolver under the current
+    // states of its formals, its callees' returns and the internal globals
+    // it reads; the sets its call sites pass, the set it returns and the
+    // values it stores to globals then flow to its callees, callers and the
+    // globals' readers, which are solved again until nothing changes.
+    void computeConstantSets(Module &M) {
+      argStates.clear();
+      returnStates.clear();
+      globalStates.clear();
+      returnFieldStates.clear();
+      allocaImages.clear();
+      findReadOnlyArgs(M);
+
+      // Internal globals whose address is only ever loaded from or stored
+      // to directly start out as their initializer.
+      std::map<GlobalVariable*, std::set<Function*>> globalReaders;
+      for (GlobalVariable &GV : M.globals())
+        if (isTrackableGlobal(GV)) {
+          globalStates[&GV] = LatticeVal::get(GV.getInitializer());
+          for (User *U : GV.users())
+            if (LoadInst *LI = dyn_cast<LoadInst>(U))
+              globalReaders[&GV].insert(LI->getParent()->getParent());
+        }
+
+      // Only internal functions reached solely through direct calls get
+      // tracked formals and returns; everything else stays overdefined.
+      // Returns are only tracked when every use of the function is a direct
+      // call, since the solver only looks them up for direct calls.
+      findIndirectCallees(M);
+      std::set<Function*> tracked;
+      for (Function &F : M) {
+        if (F.isDeclaration())
+          continue;
+        std::vector<CallSite> DirectSites;
+        std::vector<CallEdge> Sites;
+        bool Direct = collectDirectCallSites(&F, DirectSites);
+        bool Known = F.hasLocalLinkage() && !isCold(F) &&
+                     getCallSites(&F, Sites);
+        // A byval copy is only tracked when nothing writes to it.
+        for (Argument &A : F.args()) {
+          LatticeVal &V = argStates[&A];
+          if (!Known || A.hasInAllocaAttr() ||
+              (A.hasByValAttr() && !readOnlyArgs.count(&A)))
+            V.markOverdefined();
+        }
+        if (Known) {
+          tracked.insert(&F);
+          if (Direct && !F.getReturnType()->isVoidTy())
+            returnStates[&F];
+          if (StructType *STy = dyn_cast<StructType>(F.getReturnType()))
+            if (Direct)
+              for (unsigned i = 0, e = STy->getNumElements(); i != e; ++i)
+                returnFieldStates[std::make_pair(&F, i)];
+        }
+      }
+
+      const DataLayout &DL = M.getDataLayout();
+      TargetLibraryInfo *TLI =
+        &getAnalysis<TargetLibraryInfoWrapperPass>().getTLI();
+
+      // Solve optimistically first, then once more with leftover undefined
+      // values forced overdefined so that the final states can be committed.
+      for (int ResolveUndefs = 0; ResolveUndefs != 2; ++ResolveUndefs) {
+        TraceSpan Round("round", "constant-sets", "resolve-undefs",
+                        ResolveUndefs);
+        // The worklist is a stack: push the order reversed so the callers
+        // in the hottest SCCs are solved first.
+        std::map<Function*, unsigned> sccOf;
+        std::vector<Function*> worklist =
+          getProcessingOrder(M, isTracing() ? &sccOf : nullptr);
+        std::reverse(worklist.begin(), worklist.end());
+        std::set<Function*> pending(worklist.begin(), worklist.end());
+        // Consecutive solves of one SCC share a span in the trace.
+        unsigned openSCC = UINT_MAX;
+
+        while (!worklist.empty()) {
+          Function *F = worklist.back();
+          worklist.pop_back();
+          pending.erase(F);
+          if (isTracing()) {
+            HelloTraceWriter->sample("constant-sets worklist",
+                                     worklist.size());
+            unsigned SCC = sccOf[F];
+            if (SCC != openSCC) {
+              if (openSCC != UINT_MAX)
+                HelloTraceWriter->end();
+              HelloTraceWriter->begin("scc", "constant-sets", "index", SCC);
+              openSCC = SCC;
+            }
+          }
+
+          spend();
+          if (isCold(*F)) {
+            if (budget.isExhausted())
+              ++skippedSolves;
+            for (Function *C : giveUpOnCalls(*F))
+              if (pending.insert(C).second)
+                worklist.push_back(C);
+            continue;
+          }
+
+          TraceSpan Span(F->getName(), "solve");
+          FunctionSolver Solver(DL, TLI, &argStates, &returnStates,
+                                &globalStates, &returnFieldStates);
+          Solver.solve(*F, ResolveUndefs);
+
+          std::vector<Function*> changed;
+          for (BasicBlock &BB : *F) {
+            if (!Solver.isBlockExecutable(&BB))
+              continue;
+
+            if (ReturnInst *RI = dyn_cast<ReturnInst>(BB.getTerminator())) {
+              ReturnStateMap::iterator R = returnStates.find(F);
+              bool RetChanged = R != returnStates.end() &&
+                R->second.mergeIn(Solver.getValueState(RI->getReturnValue()));
+              if (StructType *STy = dyn_cast<StructType>(F->getReturnType()))
+                for (unsigned i = 0, e = STy->getNumElements(); i != e; ++i) {
+                  FieldStateMap::iterator RF =
+                    returnFieldStates.find(std::make_pair(F, i));
+                  if (RF != returnFieldStates.end())
+                    RetChanged |= RF->second.mergeIn(
+                      Solver.getFieldState(RI->getReturnValue(), i));
+                }
+              if (RetChanged)
+                for (User *U : F->users())
+                  changed.push_back(cast<Instruction>(U)->getParent()
+                                      ->getParent());
+            }
+
+            for (Instruction &I : BB) {
+              if (StoreInst *SI = dyn_cast<StoreInst>(&I)) {
+                GlobalVariable *GV =
+                  dyn_cast<GlobalVariable>(SI->getPointerOperand());
+                GlobalStateMap::iterator G =
+                  GV ? globalStates.find(GV) : globalStates.end();
+                if (G != globalStates.end() &&
+                    G->second.mergeIn(
+                      Solver.getValueState(SI->getValueOperand())))
+                  changed.insert(changed.end(), globalReaders[GV].begin(),
+                                 globalReaders[GV].end());
+                continue;
+              }
+
+              CallSite CS(&I);
+              if (!CS)
+                continue;
+              for (CallEdge &E : getCallees(CS)) {
+                if (!tracked.count(E.Callee))
+                  continue;
+                bool CalleeChanged = false;
+                for (Argument &A : E.Callee->args()) {
+                  Value *Actual = E.getActual(A.getArgNo());
+                  if (!Actual) {
+                    CalleeChanged |= argStates[&A].markOverdefined();
+                    continue;
+                  }
+                  // A formal that only reads what it points to can stand
+                  // for the constant contents of the caller's local. A
+                  // byval formal is a snapshot, so it only ever can.
+                  LatticeVal V = A.hasByValAttr() ?
+                    LatticeVal::getOverdefined() :
+                    Solver.getValueState(Actual);
+                  if (V.isOverdefined() && readOnlyArgs.count(&A))
+                    if (Constant *Image = getMemoryImage(Actual))
+                      V = LatticeVal::get(getImageGlobal(M, Image));
+                  CalleeChanged |= argStates[&A].mergeIn(V);
+                }
+                if (CalleeChanged)
+                  changed.push_back(E.Callee);
+              }
+            }
+          }
+
+          for (Function *C : changed)
+            if (pending.insert(C).second)
+              worklist.push_back(C);
+        }
+        if (openSCC != UINT_MAX)
+          HelloTraceWriter->end();
+      }
+    }
+
+    // commitConstantSets - Rewrite the module with the solved sets. Formals
+    // with a single constant are replaced outright; every function with a
+    // formal or callee result that carries a set is run through
+    // ConstantPropagation again, which folds the compares and prunes the
+    // switches that the sets decide.
+    void commitConstantSets(Module &M) {
+      std::set<Function*> toFold;
+      for (auto &Entry : argStates) {
+        Argument *A = Entry.first;
+        const LatticeVal &V = Entry.second;
+        if (!V.isConstantSet() || A->use_empty())
+          continue;
+
+        Function *F = A->getParent();
+        toFold.insert(F);
+        if (Constant *C = V.getConstant()) {
+          remarkConstantArgument(A, C);
+          A->replaceAllUsesWith(C);
+          constantArgs.insert(A);
+          dirtyFunctions.insert(F);
+          ++NumConstantsProp;
+        }
+      }
+
+      for (auto &Entry : returnStates) {
+        if (!Entry.second.isConstantSet())
+          continue;
+        for (User *U : Entry.first->users())
+          toFold.insert(cast<Instruction>(U)->getParent()->getParent());
+      }
+      for (auto &Entry : returnFieldStates) {
+        if (!Entry.second.isConstantSet())
+          continue;
+        for (User *U : Entry.first.first->users())
+          toFold.insert(cast<Instruction>(U)->getParent()->getParent());
+      }
+
+      // A global that can only ever hold its initializer is a constant:
+      // fold its loads, drop the stores that rewrite the initial value and
+      // mark it so. A global with a small set still helps its readers fold
+      // compares and switches.
+      for (auto &Entry : globalStates) {
+        GlobalVariable *GV = Entry.first;
+        const LatticeVal &V = Entry.second;
+        if (!V.isConstantSet())
+          continue;
+
+        Constant *C = V.getConstant();
+        for (auto UI = GV->user_begin(), UE = GV->user_end(); UI != UE;) {
+          Instruction *I = cast<Instruction>(*UI++);
+          Function *F = I->getParent()->getParent();
+          if (!C) {
+            toFold.insert(F);
+            continue;
+          }
+          if (!I->use_empty())
+            I->replaceAllUsesWith(C);
+          if (isa<LoadInst>(I))
+            ++NumGlobalLoadsFolded;
+          I->eraseFromParent();
+          dirtyFunctions.insert(F);
+          toFold.insert(F);
+        }
+        if (C) {
+          GV->setConstant(true);
+          ++NumGlobalsConstant;
+        }
+      }
+
+      for (Function *F : toFold) {
+        if (!isCold(*F))
+          ConstantPropagation(*F);
+        else if (budget.isExhausted())
+          ++skippedFolds;
+      }
+    }
+
+    // findReadOnlyArgs - Collect the pointer formals whose pointee is only
+    // read: loaded from, indexed, copied out of, spilled to a local that
+    // only ever holds the formal, or passed on to another such formal. The
+    // last makes this a greatest fixed point over the module, so formals
+    // passed down a recursive call tree still qualify.
+    void findReadOnlyArgs(Module &M) {
+      readOnlyArgs.clear();
+      for (Function &F : M)
+        if (!F.isDeclaration() && !F.isVarArg())
+          for (Argument &A : F.args())
+            if (A.getType()->isPointerTy() && !A.hasInAllocaAttr())
+              readOnlyArgs.insert(&A);
+
+      bool Changed = true;
+      while (Changed) {
+        Changed = false;
+        for (auto I = readOnlyArgs.begin(); I != readOnlyArgs.end();) {
+          std::set<Value*> Visited;
+          if (isOnlyRead(*I, *I, Visited)) {
+            ++I;
+            continue;
+          }
+          readOnlyArgs.erase(I++);
+          Changed = true;
+        }
+      }
+    }
+
+    // isOnlyRead - Whether the memory V, derived from formal A, points to
+    // is never written or captured through it.
+    bool isOnlyRead(Argument *A, Value *V, std::set<Value*> &Visited) {
+      if (!Visited.insert(V).second)
+        return true;
+      for (Use &U : V->uses()) {
+        User *UR = U.getUser();
+        if (LoadInst *LI = dyn_cast<LoadInst>(UR)) {
+          if (LI->isVolatile())
+            return false;
+        } else if (isa<BitCastInst>(UR) || isa<GetElementPtrInst>(UR)) {
+          if (!isOnlyRead(A, UR, Visited))
+            return false;
+        } else if (MemTransferInst *MTI = dyn_cast<MemTransferInst>(UR)) {
+          if (MTI->getRawDest() == V || MTI->isVolatile())
+            return false;
+        } else if (StoreInst *SI = dyn_cast<StoreInst>(UR)) {
+          // The -O0 spill of the formal: every load of the slot yields A.
+          AllocaInst *Slot = dyn_cast<AllocaInst>(SI->getPointerOperand());
+          if (V != A || SI->getValueOperand() != A || !Slot ||
+              !AllocaForwarding::isForwardableAlloca(Slot))
+            return false;
+          for (User *SlotUser : Slot->users()) {
+            if (StoreInst *Other = dyn_cast<StoreInst>(SlotUser)) {
+              if (Other->getValueOperand() != A)
+                return false;
+            } else if (!isOnlyRead(A, SlotUser, Visited)) {
+              return false;
+            }
+          }
+        } else if (IntrinsicInst *II = dyn_cast<IntrinsicInst>(UR)) {
+          if (II->getIntrinsicID() != Intrinsic::lifetime_start &&
+              II->getIntrinsicID() != Intrinsic::lifetime_end)
+            return false;
+        } else if (isa<CallInst>(UR) || isa<InvokeInst>(UR)) {
+          if (!passesToReadOnlyArg(CallSite(cast<Instruction>(UR)), U))
+            return false;
+        } else {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    // passesToReadOnlyArg - Whether U is an argument of a direct call that
+    // binds it to a byval or read-only formal.
+    bool passesToReadOnlyArg(CallSite CS, Use &U) {
+      Function *Callee = CS.getCalledFunction();
+      if (!Callee || Callee->isDeclaration() || !CS.isArgOperand(&U))
+        return false;
+      unsigned ArgNo = CS.getArgumentNo(&U);
+      if (ArgNo >= Callee->arg_size())
+        return false;
+      Argument *Formal = &*std::next(Callee->arg_begin(), ArgNo);
+      return Formal->hasByValAttr() || readOnlyArgs.count(Formal);
+    }
+
+    // getMemoryImage - The constant contents of the memory Ptr points to
+    // for as long as anything reads it: the initializer of a constant
+    // global, or for a local aggregate the value of its single copy from
+    // such memory, or the constants stored once into each of its fields.
+    // Fields never stored are undef. Null if the local may hold anything
+    // else or is handed to code that might write to it.
+    Constant *getMemoryImage(Value *Ptr, unsigned Depth = 0) {
+      Ptr = Ptr->stripPointerCasts();
+      if (GlobalVariable *GV = dyn_cast<GlobalVariable>(Ptr))
+        return GV->isConstant() && GV->hasDefinitiveInitializer() ?
+          GV->getInitializer() : nullptr;
+
+      AllocaInst *AI = dyn_cast<AllocaInst>(Ptr);
+      if (!AI || !AI->isStaticAlloca() || Depth > 2 ||
+          !AI->getAllocatedType()->isAggregateType())
+        return nullptr;
+      std::map<AllocaInst*, Constant*>::iterator Cached =
+        allocaImages.find(AI);
+      if (Cached != allocaImages.end())
+        return Cached->second;
+      Constant *&Image = allocaImages[AI];
+
+      Type *Ty = AI->getAllocatedType();
+      const DataLayout &DL = AI->getModule()->getDataLayout();
+      Constant *Contents = UndefValue::get(Ty);
+      bool Copied = false, Stored = false;
+
+      // Walk the uses of the alloca along with the field path they address;
+      // Cast marks pointers reinterpreted by a bitcast, which may only be
+      // read from or be the whole destination of the copy.
+      struct Addr { Value *V; SmallVector<unsigned, 4> Path; bool Cast; };
+      std::vector<Addr> Worklist(1, Addr{AI, {}, false});
+      while (!Worklist.empty()) {
+        Addr Cur = Worklist.back();
+        Worklist.pop_back();
+        for (Use &U : Cur.V->uses()) {
+          User *UR = U.getUser();
+          if (LoadInst *LI = dyn_cast<LoadInst>(UR)) {
+            if (LI->isVolatile())
+              return nullptr;
+          } else if (isa<BitCastInst>(UR)) {
+            Worklist.push_back(Addr{UR, Cur.Path, true});
+          } else if (GetElementPtrInst *GEP =
+                       dyn_cast<GetElementPtrInst>(UR)) {
+            Addr Next{GEP, Cur.Path, false};
+            if (Cur.Cast || !appendFieldPath(GEP, Next.Path))
+              return nullptr;
+            Worklist.push_back(Next);
+          } else if (StoreInst *SI = dyn_cast<StoreInst>(UR)) {
+            Constant *C = dyn_cast<Constant>(SI->getValueOperand());
+            if (Cur.Cast || SI->getPointerOperand() != Cur.V || !C ||
+                SI->isVolatile() || C->getType()->isAggregateType() ||
+                Cur.Path.empty())
+              return nullptr;
+            Constant *Old = ConstantExpr::getExtractValue(Contents, Cur.Path);
+            if (Old->getType() != C->getType() ||
+                (!isa<UndefValue>(Old) && Old != C))
+              return nullptr;
+            Contents = ConstantExpr::getInsertValue(Contents, C, Cur.Path);
+            Stored = true;
+          } else if (MemTransferInst *MTI = dyn_cast<MemTransferInst>(UR)) {
+            if (MTI->isVolatile())
+              return nullptr;
+            if (MTI->getRawDest() != Cur.V)
+              continue;
+            ConstantInt *Len = dyn_cast<ConstantInt>(MTI->getLength());
+            if (Copied || !Cur.Path.empty() || !Len ||
+                Len->getZExtValue() != DL.getTypeAllocSize(Ty))
+              return nullptr;
+            Constant *Src = getMemoryImage(MTI->getRawSource(), Depth + 1);
+            if (!Src || Src->getType() != Ty)
+              return nullptr;
+            Contents = Src;
+            Copied = true;
+          } else if (IntrinsicInst *II = dyn_cast<IntrinsicInst>(UR)) {
+            if (II->getIntrinsicID() != Intrinsic::lifetime_start &&
+                II->getIntrinsicID() != Intrinsic::lifetime_end)
+              return nullptr;
+          } else if (isa<CallInst>(UR) || isa<InvokeInst>(UR)) {
+            if (!passesToReadOnlyArg(CallSite(cast<Instruction>(UR)), U))
+              return nullptr;
+          } else {
+            return nullptr;
+          }
+        }
+      }
+      if (Copied && Stored)
+        return nullptr;
+      Image = Contents;
+      return Image;
+    }
+
+    // appendFieldPath - Extend Path with the fields a GEP with constant,
+    // in-range indices and a leading zero selects.
+    static bool appendFieldPath(GetElementPtrInst *GEP,
+                                SmallVectorImpl<unsigned> &Path) {
+      ConstantInt *First = dyn_cast<ConstantInt>(GEP->getOperand(1));
+      if (!First || !First->isZero())
+        return false;
+      Type *Ty = GEP->getSourceElementType();
+      for (unsigned i = 2, e = GEP->getNumOperands(); i != e; ++i) {
+        ConstantInt *Idx = dyn_cast<ConstantInt>(GEP->getOperand(i));
+        if (!Idx)
+          return false;
+        uint64_t N = Idx->getZExtValue();
+        if (StructType *STy = dyn_cast<StructType>(Ty)) {
+          if (N >= STy->getNumElements())
+            return false;
+          Ty = STy->getElementType(N);
+        } else if (ArrayType *ATy = dyn_cast<ArrayType>(Ty)) {
+          if (N >= ATy->getNumElements())
+            return false;
+          Ty = ATy->getElementType();
+        } else {
+          return false;
+        }
+        Path.push_back(N);
+      }
+      return true;
+    }
+
+    // getImageGlobal - A private constant global holding Image; the formals
+    // a local's contents reach are replaced by it.
+    GlobalVariable *getImageGlobal(Module &M, Constant *Image) {
+      GlobalVariable *&GV = imageGlobals[Image];
+      if (!GV) {
+        GV = new GlobalVariable(M, Image->getType(), true,
+                                GlobalValue::PrivateLinkage, Image,
+                                "hello.image");
+        GV->setUnnamedAddr(true);
+      }
+      return GV;
+    }
+
+    // removeDeadImages - Drop the image globals nothing ended up using.
+    void removeDeadImages() {
+      for (auto &Entry : imageGlobals)
+        if (Entry.second->use_empty())
+          Entry.second->eraseFromParent();
+      imageGlobals.clear();
+    }
+
+    // propagateArgFacts - Meet, over every call of each internal function
+    // whose callers are all known, what is provable about the integer and
+    // pointer actuals: their known bits, and whether pointers are nonnull
+    // and dereferenceable. An actual that is itself such a formal passes its
+    // own fact on. The facts are then made visible inside the callees, where
+    // instcombine folds the masks, remainders, alignment and null checks
+    // they decide.
+    void propagateArgFacts(Module &M) {
+      if (!HelloKnownBits && !HelloNonNull)
+        return;
+      const DataLayout &DL = M.getDataLayout();
+      TargetLibraryInfo *TLI =
+        &getAnalysis<TargetLibraryInfoWrapperPass>().getTLI();
 
+      findIndirectCallees(M);
+      std::map<Argument*, ArgFact> facts;
+      std::map<Function*, std::vector<CallEdge>> sites;
+      for (Function &F : M) {
+        std::vector<CallEdge> Sites;
+        if (F.isDeclaration() || !F.hasLocalLinkage() ||
+            !getCallSites(&F, Sites))
+          continue;
+        for (Argument &A : F.args())
+          if (A.getType()->isIntegerTy() || A.getType()->isPointerTy())
+            facts[&A];
+        sites[&F].swap(Sites);
+      }
 
-#include <vector>
-#include <map>
-#include <queue>
-#include <set>
+      // The worklist is a stack: push callers last so they are solved
+      // first. A callee is then still pending while its callers change,
+      // rather than solved again over all its calls after each of them.
+      std::vector<Function*> worklist;
+      for (Function *F : getProcessingOrder(M))
+        if (sites.count(F))
+          worklist.push_back(F);
+      std::reverse(worklist.begin(), worklist.end());
 
-using namespace llvm;
+      std::set<Function*> pending(worklist.begin(), worklist.end());
+      while (!worklist.empty()) {
+        Function *F = worklist.back();
+        worklist.pop_back();
+        pending.erase(F);
 
-#define DEBUG_TYPE "hello"
+        bool Changed = false;
+        for (Argument &A : F->args()) {
+          std::map<Argument*, ArgFact>::iterator I = facts.find(&A);
+          if (I == facts.end())
+            continue;
+          ArgFact Fact;
+          for (CallEdge &E : sites[F])
+            Fact.meet(getActualFact(E, A, facts, DL, TLI));
+          // Facts only ever weaken, so a recomputation that knows as much
+          // as before is unchanged.
+          if (Fact != I->second) {
+            I->second = Fact;
+            Changed = true;
+          }
+        }
+        if (!Changed)
+          continue;
+        for (Instruction &I : instructions(F)) {
+          CallSite CS(&I);
+          if (!CS)
+            continue;
+          for (CallEdge &E : getCallees(CS))
+            if (sites.count(E.Callee) && pending.insert(E.Callee).second)
+              worklist.push_back(E.Callee);
+        }
+      }
 
-STATISTIC(NumInstKilled, "Number of instructions killed");
-STATISTIC(NumConstantsProp, "Number of constant propagated");
-STATISTIC(NumOfArgsPop, "Number of arguments anaylzed");
+      for (auto &Entry : facts)
+        if (Entry.second.knowsAnything() && !Entry.first->use_empty())
+          applyArgFact(Entry.first, Entry.second);
+    }
 
-namespace {
-  // Hello - The first implementation, without getAnalysisUsage.
-  struct Hello : public ModulePass {
-    static char ID; // Pass identification, replacement for typeid
-    Hello() : ModulePass(ID) {}
-    
-    private:
-     std::map <llvm::Argument*,std::vector<llvm::Argument*>> consumerSet;
-    public:
-    
+    // getActualFact - What is known of the value formal A receives along E.
+    ArgFact getActualFact(CallEdge &E, Argument &A,
+                          std::map<Argument*, ArgFact> &Facts,
+                          const DataLayout &DL, const TargetLibraryInfo *TLI) {
+      unsigned BitWidth = DL.getTypeSizeInBits(A.getType());
+      ArgFact Fact;
+      Fact.Seen = true;
+      Fact.Zero = Fact.One = APInt(BitWidth, 0);
 
-    void getAnalysisUsage(AnalysisUsage &AU) const override {
-      AU.setPreservesCFG();
-      AU.addRequired<TargetLibraryInfoWrapperPass>();
+      Value *Actual = E.getActual(A.getArgNo());
+      if (!Actual)
+        return Fact;
+      Actual = AllocaForwarding::forwardedValue(Actual);
+      if (Argument *CallerArg = dyn_cast<Argument>(Actual)) {
+        std::map<Argument*, ArgFact>::iterator I = Facts.find(CallerArg);
+        if (I != Facts.end() && CallerArg->getType() == A.getType())
+          return I->second;
+      }
+      Instruction *Call = E.CS.getInstruction();
+      if (HelloKnownBits)
+        computeKnownBits(Actual, Fact.Zero, Fact.One, DL, 0, nullptr, Call);
+      if (HelloNonNull && A.getType()->isPointerTy()) {
+        // A broker may call back after the caller's locals are gone.
+        Fact.DerefBytes = E.Broker ? 0 : getDereferenceableBytes(Actual, DL);
+        Fact.NonNull = Fact.DerefBytes ||
+          isKnownNonNullAt(Actual, Call, nullptr, TLI);
+      }
+      return Fact;
+    }
+
+    // getDereferenceableBytes - How many bytes from V on are known to be
+    // dereferenceable: a whole local or defined global it points into the
+    // start of, or what a formal's own attribute promises.
+    static uint64_t getDereferenceableBytes(Value *V, const DataLayout &DL) {
+      V = V->stripPointerCasts();
+      if (AllocaInst *AI = dyn_cast<AllocaInst>(V)) {
+        ConstantInt *N = dyn_cast<ConstantInt>(AI->getArraySize());
+        if (N && AI->getAllocatedType()->isSized())
+          return N->getZExtValue() *
+                 DL.getTypeAllocSize(AI->getAllocatedType());
+      } else if (GlobalVariable *GV = dyn_cast<GlobalVariable>(V)) {
+        if (!GV->hasExternalWeakLinkage() && GV->getValueType()->isSized())
+          return DL.getTypeAllocSize(GV->getValueType());
+      } else if (Argument *A = dyn_cast<Argument>(V)) {
+        return A->getDereferenceableBytes();
+      }
+      return 0;
     }
 
+    // applyArgFact - Record Fact on A: alignment, nonnull and dereferenceable
+    // attributes for a pointer, an llvm.assume of the known bits for an
+    // integer. Reloads of the -O0 spill of A are forwarded to A itself so
+    // the facts reach its uses.
+    void applyArgFact(Argument *A, const ArgFact &Fact) {
+      Function *F = A->getParent();
+      LLVMContext &Ctx = F->getContext();
+      Instruction *InsertPt = &*F->getEntryBlock().begin();
+      while (isa<AllocaInst>(InsertPt))
+        InsertPt = InsertPt->getNextNode();
 
-    bool runOnModule(Module &M) override {
-      initConsumerSets(M); 
-      // Print Consumer Sets
-      for(auto &formalP : consumerSet) {
-        //errs() << "The consumers of " << *(formalP.first) << "\n";
-        for(auto &supp : formalP.second){
-        //  errs() << *supp << '\n';
+      if (A->getType()->isPointerTy()) {
+        AttrBuilder B;
+        unsigned Align = 1u << std::min(Fact.Zero.countTrailingOnes(), 29u);
+        if (Align > 1 && Align > A->getParamAlignment()) {
+          B.addAlignmentAttr(Align);
+          ++NumKnownBitsArgs;
         }
+        if (Fact.NonNull && !A->hasNonNullAttr()) {
+          B.addAttribute(Attribute::NonNull);
+          ++NumNonNullArgs;
+        }
+        if (Fact.DerefBytes > A->getDereferenceableBytes())
+          B.addDereferenceableAttr(Fact.DerefBytes);
+        if (!B.hasAttributes())
+          return;
+        A->addAttr(AttributeSet::get(Ctx, A->getArgNo() + 1, B));
+      } else {
+        ++NumKnownBitsArgs;
+        APInt Mask = Fact.Zero | Fact.One;
+        Instruction *Masked = BinaryOperator::CreateAnd(
+          A, ConstantInt::get(Ctx, Mask), A->getName() + ".known", InsertPt);
+        Instruction *Cond = new ICmpInst(InsertPt, ICmpInst::ICMP_EQ, Masked,
+                                         ConstantInt::get(Ctx, Fact.One));
+        Function *Assume =
+          Intrinsic::getDeclaration(F->getParent(), Intrinsic::assume);
+        CallInst::Create(Assume, Cond, "", InsertPt);
       }
-      ipConstantProp(M);
 
+      AllocaForwarding Fwd(*F);
+      std::vector<LoadInst*> Reloads;
+      for (Instruction &I : instructions(F))
+        if (LoadInst *LI = dyn_cast<LoadInst>(&I))
+          if (StoreInst *SI = Fwd.getReachingStore(LI))
+            if (SI->getValueOperand() == A)
+              Reloads.push_back(LI);
+      for (LoadInst *LI : Reloads) {
+        LI->replaceAllUsesWith(A);
+        LI->eraseFromParent();
+      }
 
-      return false;
+      dirtyFunctions.insert(F);
     }
 
-    void ipConstantProp(Module &M) {
-      std::queue<llvm::Argument*> worklist;
+    // isTrackableGlobal - An internal, non-constant global of scalar type
+    // whose only uses are simple loads from it and simple stores to it, so
+    // every value it can hold is visible in the module.
+    static bool isTrackableGlobal(GlobalVariable &GV) {
+      if (!GV.hasLocalLinkage() || GV.isConstant() ||
+          !GV.hasDefinitiveInitializer() || GV.isThreadLocal() ||
+          !GV.getValueType()->isSingleValueType())
+        return false;
+      for (User *U : GV.users()) {
+        if (LoadInst *LI = dyn_cast<LoadInst>(U)) {
+          if (!LI->isSimple())
+            return false;
+        } else if (StoreInst *SI = dyn_cast<StoreInst>(U)) {
+          if (!SI->isSimple() || SI->getValueOperand() == &GV)
+            return false;
+        } else {
+          return false;
+        }
+      }
+      return true;
+    }
 
-      // Initialize worklist queue with every formal param of every function
-      for(Module::iterator F=M.begin(), E=M.end(); F != E ; ++F){
-        Function::arg_iterator formal_param = F->arg_begin();
-        Function::arg_iterator FE = F->arg_end();
+    // specializeFunctions - Clone internal functions on a formal that feeds
+    // a switch or compare and takes between two and MaxArgConstants
+    // constants: one copy per constant, with each call site pointed at the
+    // copy for the constant it passes.
+    void specializeFunctions(Module &M) {
+      if (!HelloSpecialize)
+        return;
 
-        for(;formal_param != FE; ++formal_param){
-          worklist.push(formal_param);
+      std::vector<Function*> candidates;
+      for (Function &F : M)
+        candidates.push_back(&F);
+
+      for (Function *F : candidates) {
+        if (!F->hasLocalLinkage() || F->isDeclaration() || F->isVarArg() ||
+            isCold(*F) || getInstructionCount(*F) > HelloSpecializeMaxSize)
+          continue;
+
+        std::vector<CallSite> Sites;
+        if (!collectDirectCallSites(F, Sites) || Sites.empty())
+          continue;
+        Argument *A = chooseSpecializationArg(F, Sites);
+        if (!A)
+          continue;
+
+        // A copy is only worth making for a constant whose calls run often
+        // enough; the other calls keep calling F.
+        std::map<Constant*, uint64_t> Counts;
+        for (CallSite &CS : Sites) {
+          uint64_t &Count = Counts[cast<Constant>(
+            AllocaForwarding::forwardedValue(CS.getArgument(A->getArgNo())))];
+          uint64_t Calls = getCallCount(CS);
+          Count = Count > UINT64_MAX - Calls ? UINT64_MAX : Count + Calls;
+        }
+
+        for (CallSite &CS : Sites) {
+          std::vector<Constant*> Consts(F->arg_size(), nullptr);
+          Consts[A->getArgNo()] = cast<Constant>(
+            AllocaForwarding::forwardedValue(CS.getArgument(A->getArgNo())));
+          if (Counts[Consts[A->getArgNo()]] < HelloSpecializeMinCount)
+            continue;
+          Function *NF = getOrCreateSpecialization(F, Consts);
+          dirtyFunctions.insert(CS.getCaller());
+          rewriteCallSite(CS, NF, keepMask(Consts));
         }
+        if (F->use_empty())
+          eraseFunction(F);
       }
+    }
 
+    // isValueProfileCandidate - An integer formal of at most 64 bits that
+    // decides a compare or switch, in a function the pass can clone.
+    static bool isValueProfileCandidate(Argument &A) {
+      Function *F = A.getParent();
+      IntegerType *Ty = dyn_cast<IntegerType>(A.getType());
+      return Ty && Ty->getBitWidth() <= 64 && !F->isDeclaration() &&
+             !F->isVarArg() && feedsDecision(&A);
+    }
 
-      llvm::Argument *current_formal_param;
-      bool isConstant = false;
-      while(!worklist.empty()) {
-        current_formal_param = worklist.front();
-        worklist.pop();
-        ++NumOfArgsPop;
-        isConstant = isFormalParamConstant(current_formal_param);
-        if (isConstant) {
-          //errs() << "I am a constant formal param: " << *current_formal_param << '\n';
-          ConstantPropagation(*(current_formal_param->getParent()));
-          ++NumConstantsProp;
-          for(auto &consumerParam : consumerSet[current_formal_param]) {
-            worklist.push(consumerParam);
+    // instrumentValueProfile - On entry to each candidate function, count
+    // the values of its candidate formals in a small table per formal: up
+    // to HelloValueProfileSlots (value, count) pairs, then a count of the
+    // calls that fit none. A destructor appends every table to the profile
+    // file as "function argno value count" lines, "-" standing for the
+    // misses. The counters are not atomic, like gcov's.
+    bool instrumentValueProfile(Module &M) {
+      std::vector<Argument*> Candidates;
+      for (Function &F : M)
+        for (Argument &A : F.args())
+          if (isValueProfileCandidate(A))
+            Candidates.push_back(&A);
+      if (Candidates.empty())
+        return false;
+
+      LLVMContext &Ctx = M.getContext();
+      unsigned Slots = std::max(1u, unsigned(HelloValueProfileSlots));
+      Type *Int64Ty = Type::getInt64Ty(Ctx);
+      ArrayType *TableTy = ArrayType::get(Int64Ty, 2 * Slots + 1);
+      Function *Record = createValueProfileRecorder(M, Slots);
+
+      std::vector<std::pair<Argument*, GlobalVariable*>> Tables;
+      for (Argument *A : Candidates) {
+        Function *F = A->getParent();
+        GlobalVariable *Table = new GlobalVariable(
+          M, TableTy, false, GlobalValue::PrivateLinkage,
+          ConstantAggregateZero::get(TableTy), "hello.vp." + F->getName());
+        Tables.push_back(std::make_pair(A, Table));
+
+        IRBuilder<> B(&*F->getEntryBlock().getFirstInsertionPt());
+        Value *Slot0 = B.CreateConstInBoundsGEP2_32(TableTy, Table, 0, 0);
+        B.CreateCall(Record, { Slot0, B.CreateSExt(A, Int64Ty) });
+        ++NumValueProfiled;
+      }
+
+      appendToGlobalDtors(M, createValueProfileWriter(M, Slots, Tables), 0);
+      return true;
+    }
+
+    // createValueProfileRecorder - Build the function that counts a value
+    // in a table: bump the slot holding it, else claim the first empty
+    // slot, else count a miss.
+    Function *createValueProfileRecorder(Module &M, unsigned Slots) {
+      LLVMContext &Ctx = M.getContext();
+      Type *Int64Ty = Type::getInt64Ty(Ctx);
+      Type *VoidTy = Type::getVoidTy(Ctx);
+      FunctionType *FTy = FunctionType::get(
+        VoidTy, { Int64Ty->getPointerTo(), Int64Ty }, false);
+      Function *Record = Function::Create(FTy, GlobalValue::PrivateLinkage,
+                                          "hello.vp.record", &M);
+      Function::arg_iterator AI = Record->arg_begin();
+      Value *Table = &*AI++;
+      Value *V = &*AI;
+
+      BasicBlock *Entry = BasicBlock::Create(Ctx, "entry", Record);
+      BasicBlock *Loop = BasicBlock::Create(Ctx, "loop", Record);
+      BasicBlock *Claim = BasicBlock::Create(Ctx, "claim", Record);
+      BasicBlock *Check = BasicBlock::Create(Ctx, "check", Record);
+      BasicBlock *Bump = BasicBlock::Create(Ctx, "bump", Record);
+      BasicBlock *Next = BasicBlock::Create(Ctx, "next", Record);
+      BasicBlock *Miss = BasicBlock::Create(Ctx, "miss", Record);
+
+      IRBuilder<> B(Entry);
+      B.CreateBr(Loop);
+
+      B.SetInsertPoint(Loop);
+      PHINode *I = B.CreatePHI(Int64Ty, 2, "i");
+      Value *ValueSlot = B.CreateInBoundsGEP(Int64Ty, Table,
+                                             B.CreateShl(I, 1));
+      Value *CountSlot = B.CreateConstInBoundsGEP1_32(Int64Ty, ValueSlot, 1);
+      Value *Count = B.CreateLoad(CountSlot);
+      B.CreateCondBr(B.CreateICmpEQ(Count, B.getInt64(0)), Claim, Check);
+
+      B.SetInsertPoint(Claim);
+      B.CreateStore(V, ValueSlot);
+      B.CreateStore(B.getInt64(1), CountSlot);
+      B.CreateRetVoid();
+
+      B.SetInsertPoint(Check);
+      B.CreateCondBr(B.CreateICmpEQ(B.CreateLoad(ValueSlot), V), Bump, Next);
+
+      B.SetInsertPoint(Bump);
+      B.CreateStore(B.CreateAdd(Count, B.getInt64(1)), CountSlot);
+      B.CreateRetVoid();
+
+      B.SetInsertPoint(Next);
+      Value *INext = B.CreateAdd(I, B.getInt64(1));
+      B.CreateCondBr(B.CreateICmpEQ(INext, B.getInt64(Slots)), Miss, Loop);
+      I->addIncoming(B.getInt64(0), Entry);
+      I->addIncoming(INext, Next);
+
+      B.SetInsertPoint(Miss);
+      Value *MissSlot = B.CreateConstInBoundsGEP1_32(Int64Ty, Table,
+                                                     2 * Slots);
+      B.CreateStore(B.CreateAdd(B.CreateLoad(MissSlot), B.getInt64(1)),
+                    MissSlot);
+      B.CreateRetVoid();
+      return Record;
+    }
+
+    // createValueProfileWriter - Build the destructor that appends every
+    // table to the profile file.
+    Function *createValueProfileWriter(
+        Module &M, unsigned Slots,
+        const std::vector<std::pair<Argument*, GlobalVariable*>> &Tables) {
+      LLVMContext &Ctx = M.getContext();
+      Type *Int8PtrTy = Type::getInt8PtrTy(Ctx);
+      Type *Int32Ty = Type::getInt32Ty(Ctx);
+      Constant *FOpen = M.getOrInsertFunction("fopen",
+        FunctionType::get(Int8PtrTy, { Int8PtrTy, Int8PtrTy }, false));
+      Constant *FPrintf = M.getOrInsertFunction("fprintf",
+        FunctionType::get(Int32Ty, { Int8PtrTy, Int8PtrTy }, true));
+      Constant *FClose = M.getOrInsertFunction("fclose",
+        FunctionType::get(Int32Ty, { Int8PtrTy }, false));
+
+      Function *Writer = Function::Create(
+        FunctionType::get(Type::getVoidTy(Ctx), false),
+        GlobalValue::PrivateLinkage, "hello.vp.write", &M);
+      BasicBlock *Entry = BasicBlock::Create(Ctx, "entry", Writer);
+      BasicBlock *Write = BasicBlock::Create(Ctx, "write", Writer);
+      BasicBlock *Done = BasicBlock::Create(Ctx, "done", Writer);
+
+      IRBuilder<> B(Entry);
+      Value *File = B.CreateCall(FOpen, {
+        B.CreateGlobalStringPtr(HelloValueProfileGen, "hello.vp.file"),
+        B.CreateGlobalStringPtr("a", "hello.vp.mode") });
+      B.CreateCondBr(B.CreateIsNull(File), Done, Write);
+
+      B.SetInsertPoint(Write);
+      Value *ValueFmt = B.CreateGlobalStringPtr("%s %u %lld %llu\n",
+                                                "hello.vp.fmt");
+      Value *MissFmt = B.CreateGlobalStringPtr("%s %u - %llu\n",
+                                               "hello.vp.missfmt");
+      for (auto &Entry : Tables) {
+        Argument *A = Entry.first;
+        Value *Name = B.CreateGlobalStringPtr(A->getParent()->getName(),
+                                              "hello.vp.name");
+        Value *ArgNo = B.getInt32(A->getArgNo());
+        for (unsigned i = 0; i != Slots; ++i) {
+          Value *V = B.CreateLoad(B.CreateConstInBoundsGEP2_32(
+            Entry.second->getValueType(), Entry.second, 0, 2 * i));
+          Value *Count = B.CreateLoad(B.CreateConstInBoundsGEP2_32(
+            Entry.second->getValueType(), Entry.second, 0, 2 * i + 1));
+          B.CreateCall(FPrintf, { File, ValueFmt, Name, ArgNo, V, Count });
+        }
+        Value *Misses = B.CreateLoad(B.CreateConstInBoundsGEP2_32(
+          Entry.second->getValueType(), Entry.second, 0, 2 * Slots));
+        B.CreateCall(FPrintf, { File, MissFmt, Name, ArgNo, Misses });
+      }
+      B.CreateCall(FClose, File);
+      B.CreateBr(Done);
+
+      B.SetInsertPoint(Done);
+      B.CreateRetVoid();
+      return Writer;
+    }
+
+    // applyValueProfile - Read a profile written by -hello-value-profile-gen
+    // and, for each candidate formal whose most frequent value covers at
+    // least HelloValueProfileMinPercent of its calls, guard every direct
+    // call on that value: equal calls go to a copy specialized for it, the
+    // rest to the original.
+    void applyValueProfile(Module &M) {
+      ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer =
+        MemoryBuffer::getFile(HelloValueProfileUse);
+      if (!Buffer) {
+        errs() << "hello: cannot read value profile '" << HelloValueProfileUse
+               << "': " << Buffer.getError().message() << '\n';
+        return;
+      }
+
+      // Runs append to the file, so the same value can appear many times.
+      typedef std::pair<std::string, unsigned> FormalKey;
+      std::map<FormalKey, std::map<int64_t, uint64_t>> Values;
+      std::map<FormalKey, uint64_t> Totals;
+      for (line_iterator L(**Buffer); !L.is_at_eof(); ++L) {
+        SmallVector<StringRef, 4> Fields;
+        L->split(Fields, ' ', -1, false);
+        unsigned ArgNo;
+        int64_t V;
+        uint64_t Count;
+        if (Fields.size() != 4 || Fields[1].getAsInteger(10, ArgNo) ||
+            Fields[3].getAsInteger(10, Count))
+          continue;
+        FormalKey Key(Fields[0].str(), ArgNo);
+        Totals[Key] += Count;
+        if (Fields[2] != "-" && !Fields[2].getAsInteger(10, V) && Count)
+          Values[Key][V] += Count;
+      }
+
+      for (auto &Entry : Values) {
+        Function *F = M.getFunction(Entry.first.first);
+        if (!F || Entry.first.second >= F->arg_size())
+          continue;
+        Argument &A = *std::next(F->arg_begin(), Entry.first.second);
+        if (!isValueProfileCandidate(A) ||
+            getInstructionCount(*F) > HelloSpecializeMaxSize)
+          continue;
+
+        std::pair<int64_t, uint64_t> Best(0, 0);
+        for (auto &VC : Entry.second)
+          if (VC.second > Best.second)
+            Best = VC;
+        uint64_t Total = Totals[Entry.first];
+        if (!Best.second ||
+            Best.second * 100 < Total * uint64_t(HelloValueProfileMinPercent))
+          continue;
+
+        Constant *C = ConstantInt::get(A.getType(), Best.first, true);
+        guardCallsOnValue(F, A, C, Best.second, Total - Best.second);
+      }
+
+      // The copies are ordinary internal functions from here on. What the
+      // later phases prove of their formals only holds for the calls they
+      // have now, so no other call may be redirected to them.
+      specializations.clear();
+    }
+
+    // guardCallsOnValue - Split each direct call of F into a call of the
+    // copy of F specialized for A == C when the actual equals C, and the
+    // original call otherwise. Calls passing a literal need no guard.
+    void guardCallsOnValue(Function *F, Argument &A, Constant *C,
+                           uint64_t Hits, uint64_t Misses) {
+      std::vector<CallInst*> Calls;
+      for (Use &U : F->uses()) {
+        CallInst *CI = dyn_cast<CallInst>(U.getUser());
+        if (CI && CallSite(CI).isCallee(&U) && !CI->isMustTailCall())
+          Calls.push_back(CI);
+      }
+      if (Calls.empty())
+        return;
+
+      std::vector<Constant*> Consts(F->arg_size(), nullptr);
+      Consts[A.getArgNo()] = C;
+      Function *NF = getOrCreateSpecialization(F, Consts);
+      MDNode *Weights = MDBuilder(F->getContext()).createBranchWeights(
+        uint32_t(std::min<uint64_t>(Hits, UINT32_MAX)),
+        uint32_t(std::min<uint64_t>(Misses, UINT32_MAX)));
+
+      for (CallInst *Call : Calls) {
+        Value *Actual = Call->getArgOperand(A.getArgNo());
+        dirtyFunctions.insert(Call->getParent()->getParent());
+        if (isa<Constant>(Actual)) {
+          if (Actual == C)
+            rewriteCallSite(CallSite(Call), NF, keepMask(Consts));
+          continue;
+        }
+
+        Value *Cond = new ICmpInst(Call, ICmpInst::ICMP_EQ, Actual, C,
+                                   A.getName() + ".isprofiled");
+        TerminatorInst *ThenTerm, *ElseTerm;
+        SplitBlockAndInsertIfThenElse(Cond, Call, &ThenTerm, &ElseTerm,
+                                      Weights);
+        BasicBlock *Tail = Call->getParent();
+        Call->moveBefore(ElseTerm);
+        Instruction *Fast = Call->clone();
+        Fast->insertBefore(ThenTerm);
+        Fast = rewriteCallSite(CallSite(Fast), NF, keepMask(Consts));
+        if (!Call->use_empty()) {
+          PHINode *PN = PHINode::Create(Call->getType(), 2, "", &Tail->front());
+          Call->replaceAllUsesWith(PN);
+          PN->addIncoming(Fast, ThenTerm->getParent());
+          PN->addIncoming(Call, ElseTerm->getParent());
+          PN->takeName(Call);
+        }
+        ++NumGuardedCalls;
+        if (remarksEnabled) {
+          Remark R(true, "GuardedCall", *Tail->getParent(),
+                   Call->getDebugLoc());
+          R << "call given a fast path to ";
+          R.arg("Specialization", NF) << " when ";
+          R.arg("Argument", &A) << " is ";
+          emitRemark(R.arg("Constant", C));
+        }
+      }
+    }
+
+    // getProcessingOrder - The defined functions, callers before callees
+    // SCC by SCC. With a profile, hotter SCCs come first; SCCs equally hot
+    // keep that order. SCCOf, if given, maps each function to the position
+    // of its SCC in that order.
+    std::vector<Function*> getProcessingOrder(Module &M,
+        std::map<Function*, unsigned> *SCCOf = nullptr) {
+      std::vector<std::vector<Function*>> SCCs;
+      CallGraph CG(M);
+      for (scc_iterator<CallGraph*> I = scc_begin(&CG); !I.isAtEnd(); ++I) {
+        std::vector<Function*> SCC;
+        for (CallGraphNode *Node : *I)
+          if (Function *F = Node->getFunction())
+            if (!F->isDeclaration())
+              SCC.push_back(F);
+        if (!SCC.empty())
+          SCCs.push_back(SCC);
+      }
+      // scc_iterator visits callees first.
+      std::reverse(SCCs.begin(), SCCs.end());
+
+      if (HelloProfile) {
+        auto Heat = [&](const std::vector<Function*> &SCC) {
+          uint64_t Max = 0;
+          for (Function *F : SCC)
+            if (Optional<uint64_t> Count = F->getEntryCount())
+              Max = std::max(Max, *Count);
+          return Max;
+        };
+        std::stable_sort(SCCs.begin(), SCCs.end(),
+          [&](const std::vector<Function*> &L,
+              const std::vector<Function*> &R) {
+            return Heat(L) > Heat(R);
+          });
+      }
+
+      std::vector<Function*> Order;
+      for (unsigned i = 0, e = SCCs.size(); i != e; ++i) {
+        Order.insert(Order.end(), SCCs[i].begin(), SCCs[i].end());
+        if (SCCOf)
+          for (Function *F : SCCs[i])
+            (*SCCOf)[F] = i;
+      }
+      return Order;
+    }
+
+    // getCallCount - How many times the profile says CS ran: the caller's
+    // entry count scaled by the relative frequency of the call's block.
+    // Without a profile every call counts as often as it could.
+    uint64_t getCallCount(CallSite CS) {
+      if (!HelloProfile)
+        return UINT64_MAX;
+      Function *Caller = CS.getCaller();
+      Optional<uint64_t> Entry = Caller->getEntryCount();
+      if (!Entry)
+        return UINT64_MAX;
+      BlockFrequencyInfo &BFI =
+        getAnalysis<BlockFrequencyInfoWrapperPass>(*Caller).getBFI();
+      uint64_t EntryFreq = BFI.getEntryFreq();
+      if (!EntryFreq)
+        return 0;
+      APInt Count(128, *Entry);
+      Count *= APInt(128, BFI.getBlockFreq(CS.getInstruction()->getParent()).getFrequency());
+      Count = Count.udiv(APInt(128, EntryFreq));
+      return Count.getActiveBits() > 64 ? UINT64_MAX : Count.getZExtValue();
+    }
+
+    // isCold - Whether F is left alone: with -hello-skip-cold, a function
+    // the profile shows entered at most HelloColdCount times. Once the
+    // compile-time budget is gone, every function is.
+    bool isCold(Function &F) {
+      if (budget.isExhausted())
+        return true;
+      if (!HelloProfile || !HelloSkipCold)
+        return false;
+      Optional<uint64_t> Count = F.getEntryCount();
+      return Count && *Count <= HelloColdCount;
+    }
+
+    // giveUpOnCalls - Account for the cold function F without solving it:
+    // a literal it passes to a tracked callee or stores to a tracked global
+    // is taken as is, anything else is overdefined. Returns the functions
+    // whose inputs changed.
+    std::vector<Function*> giveUpOnCalls(Function &F) {
+      std::vector<Function*> Changed;
+      // A function that turned cold once solved, when the budget ran out,
+      // may have returned something optimistic so far.
+      bool RetChanged = false;
+      ReturnStateMap::iterator R = returnStates.find(&F);
+      if (R != returnStates.end())
+        RetChanged |= R->second.markOverdefined();
+      if (StructType *STy = dyn_cast<StructType>(F.getReturnType()))
+        for (unsigned i = 0, e = STy->getNumElements(); i != e; ++i) {
+          FieldStateMap::iterator RF =
+            returnFieldStates.find(std::make_pair(&F, i));
+          if (RF != returnFieldStates.end())
+            RetChanged |= RF->second.markOverdefined();
+        }
+      if (RetChanged)
+        for (User *U : F.users())
+          Changed.push_back(cast<Instruction>(U)->getParent()->getParent());
+
+      for (Instruction &I : instructions(&F)) {
+        if (StoreInst *SI = dyn_cast<StoreInst>(&I)) {
+          GlobalVariable *GV =
+            dyn_cast<GlobalVariable>(SI->getPointerOperand());
+          GlobalStateMap::iterator G =
+            GV ? globalStates.find(GV) : globalStates.end();
+          if (G == globalStates.end())
+            continue;
+          Constant *C = dyn_cast<Constant>(SI->getValueOperand());
+          if (C ? G->second.mergeIn(LatticeVal::get(C))
+                : G->second.markOverdefined())
+            for (User *U : GV->users())
+              if (LoadInst *LI = dyn_cast<LoadInst>(U))
+                Changed.push_back(LI->getParent()->getParent());
+          continue;
+        }
+        CallSite CS(&I);
+        if (!CS)
+          continue;
+        for (CallEdge &E : getCallees(CS)) {
+          bool CalleeChanged = false;
+          for (Argument &A : E.Callee->args()) {
+            ArgStateMap::iterator AS = argStates.find(&A);
+            if (AS == argStates.end())
+              continue;
+            // Solved or not, F passes a literal as it is, when it calls.
+            Constant *C = dyn_cast_or_null<Constant>(
+              E.getActual(A.getArgNo()));
+            if (C && !A.hasByValAttr())
+              CalleeChanged |= AS->second.mergeIn(LatticeVal::get(C));
+            else
+              CalleeChanged |= AS->second.markOverdefined();
           }
+          if (CalleeChanged)
+            Changed.push_back(E.Callee);
         }
       }
+      return Changed;
     }
-    
+
+    // specializeContexts - Call-string context sensitivity, realized by
+    // cloning. A callee reached with different constants from different
+    // callers is overdefined in argStates; here each call is looked at in
+    // the context of its caller instead, and a call passing constants the
+    // callee does not already have everywhere is pointed at a copy made for
+    // them. Contexts are memoized by the constants they bind, so call
+    // strings that agree share one copy and one solve. The copies made at
+    // one level are the callers examined at the next, which extends the
+    // call string by one call per level up to HelloContextDepth; at most
+    // HelloMaxContexts calls are redirected in all.
+    void specializeContexts(Module &M) {
+      unsigned Depth = std::min(unsigned(HelloContextDepth), 2u);
+      unsigned Budget = HelloMaxContexts;
+      const DataLayout &DL = M.getDataLayout();
+      TargetLibraryInfo *TLI =
+        &getAnalysis<TargetLibraryInfoWrapperPass>().getTLI();
+
+      std::vector<Function*> callers = getProcessingOrder(M);
+      // Callees that may have lost their last call; erased once done.
+      std::set<Function*> retired;
+
+      for (unsigned Level = 0; Level != Depth && Budget; ++Level) {
+        std::vector<Function*> copies;
+        for (Function *G : callers) {
+          if (isCold(*G))
+            continue;
+          FunctionSolver Solver(DL, TLI, &argStates, &returnStates,
+                                &globalStates, &returnFieldStates);
+          Solver.solve(*G);
+
+          std::vector<std::pair<CallSite, std::vector<Constant*>>> calls;
+          std::map<Instruction*, uint64_t> counts;
+          for (BasicBlock &BB : *G) {
+            if (!Solver.isBlockExecutable(&BB))
+              continue;
+            for (Instruction &I : BB) {
+              CallSite CS(&I);
+              Function *F = CS ? CS.getCalledFunction() : nullptr;
+              if (!F || F->isDeclaration() || F->isVarArg() ||
+                  (CS.isCall() && cast<CallInst>(&I)->isMustTailCall()) ||
+                  getInstructionCount(*F) > HelloSpecializeMaxSize)
+                continue;
+              uint64_t Count = getCallCount(CS);
+              if (Count < HelloSpecializeMinCount)
+                continue;
+              counts[&I] = Count;
+
+              std::vector<Constant*> Consts(F->arg_size(), nullptr);
+              bool Gain = false;
+              for (Argument &A : F->args()) {
+                Constant *C =
+                  Solver.getValueState(CS.getArgument(A.getArgNo()))
+                    .getConstant();
+                ArgStateMap::iterator AS = argStates.find(&A);
+                if (!C || A.use_empty() || A.hasByValAttr() ||
+                    A.hasInAllocaAttr() ||
+                    (AS != argStates.end() && AS->second.isConstant()))
+                  continue;
+                Consts[A.getArgNo()] = C;
+                Gain = true;
+              }
+              if (Gain)
+                calls.push_back(std::make_pair(CS, Consts));
+            }
+          }
+
+          // Spend the budget on the hottest calls first.
+          std::stable_sort(calls.begin(), calls.end(),
+            [&](const std::pair<CallSite, std::vector<Constant*>> &L,
+                const std::pair<CallSite, std::vector<Constant*>> &R) {
+              return counts[L.first.getInstruction()] >
+                     counts[R.first.getInstruction()];
+            });
+          for (auto &Call : calls) {
+            if (!Budget)
+              break;
+            --Budget;
+            Function *F = Call.first.getCalledFunction();
+            bool Seen = specializations.count(std::make_pair(F, Call.second));
+            Function *NF = getOrCreateSpecialization(F, Call.second);
+            if (!Seen)
+              copies.push_back(NF);
+            dirtyFunctions.insert(G);
+            if (remarksEnabled) {
+              Remark R(true, "ContextCall", *G,
+                       Call.first.getInstruction()->getDebugLoc());
+              R << "call to ";
+              R.arg("Callee", F) << " redirected to ";
+              emitRemark(R.arg("Specialization", NF));
+            }
+            rewriteCallSite(Call.first, NF, keepMask(Call.second));
+            ++NumContextCalls;
+            retired.insert(F);
+          }
+        }
+        callers.swap(copies);
+      }
+
+      for (Function *F : retired)
+        if (F->use_empty() && F->hasLocalLinkage())
+          eraseFunction(F);
+    }
+
+    // chooseSpecializationArg - Pick the formal of F to clone on: it must
+    // decide a compare or switch, carry a set of at least two constants and
+    // receive a literal constant at every call site. Smaller sets win.
+    Argument *chooseSpecializationArg(Function *F,
+                                      std::vector<CallSite> &Sites) {
+      Argument *Best = nullptr;
+      for (Argument &A : F->args()) {
+        ArgStateMap::iterator I = argStates.find(&A);
+        if (I == argStates.end())
+          continue;
+        const LatticeVal &V = I->second;
+        if (!V.isConstantSet() || V.Values.size() < 2)
+          continue;
+
+        if (!feedsDecision(&A))
+          continue;
+
+        bool AllConstant = true;
+        for (CallSite &CS : Sites)
+          AllConstant &= isa<Constant>(
+            AllocaForwarding::forwardedValue(CS.getArgument(A.getArgNo())));
+        if (!AllConstant)
+          continue;
+
+        if (!Best || V.Values.size() < argStates[Best].Values.size())
+          Best = &A;
+      }
+      return Best;
+    }
+
+    // feedsDecision - Whether A is compared or switched on, either directly
+    // or after being spilled to a local that never escapes.
+    static bool feedsDecision(Argument *A) {
+      for (User *U : A->users()) {
+        if (isa<CmpInst>(U) || isa<SwitchInst>(U))
+          return true;
+        StoreInst *SI = dyn_cast<StoreInst>(U);
+        AllocaInst *AI =
+          SI ? dyn_cast<AllocaInst>(SI->getPointerOperand()) : nullptr;
+        if (!AI || !AllocaForwarding::isForwardableAlloca(AI))
+          continue;
+        for (User *SlotUser : AI->users())
+          if (isa<LoadInst>(SlotUser))
+            for (User *LU : SlotUser->users())
+              if (isa<CmpInst>(LU) || isa<SwitchInst>(LU))
+                return true;
+      }
+      return false;
+    }
+
+    // getOrCreateSpecialization - Return a copy of F in which each formal
+    // with a non-null entry in Consts is replaced by that constant and
+    // dropped from the signature. Callers asking for the same constants
+    // share one copy.
+    Function *getOrCreateSpecialization(Function *F,
+                                        const std::vector<Constant*> &Consts) {
+      Function *&NF = specializations[std::make_pair(F, Consts)];
+      if (NF)
+        return NF;
+
+      std::vector<Type*> Params;
+      for (Argument &A : F->args())
+        if (!Consts[A.getArgNo()])
+          Params.push_back(A.getType());
+      FunctionType *NFTy = FunctionType::get(F->getReturnType(), Params,
+                                             false);
+      NF = Function::Create(NFTy, GlobalValue::InternalLinkage,
+                            F->getName() + ".spec", F->getParent());
+
+      ValueToValueMapTy VMap;
+      Function::arg_iterator NI = NF->arg_begin();
+      for (Argument &A : F->args()) {
+        if (Constant *C = Consts[A.getArgNo()]) {
+          VMap[&A] = C;
+          continue;
+        }
+        NI->setName(A.getName());
+        VMap[&A] = &*NI++;
+      }
+      SmallVector<ReturnInst*, 8> Returns;
+      CloneFunctionInto(NF, F, VMap, false, Returns, ".spec");
+      NF->setLinkage(GlobalValue::InternalLinkage);
+
+      ++NumSpecializations;
+      if (remarksEnabled) {
+        Remark R(true, "Specialized", *F);
+        R.arg("Specialization", NF) << " is ";
+        R.arg("Callee", F) << " with";
+        for (Argument &A : F->args())
+          if (Constant *C = Consts[A.getArgNo()]) {
+            R << " ";
+            R.arg("Argument", &A) << " = ";
+            R.arg("Constant", C);
+          }
+        emitRemark(R);
+      }
+      dirtyFunctions.insert(NF);
+      ConstantPropagation(*NF);
+      return NF;
+    }
+
+    static std::vector<bool> keepMask(const std::vector<Constant*> &Consts) {
+      std::vector<bool> Keep(Consts.size());
+      for (unsigned i = 0, e = Consts.size(); i != e; ++i)
+        Keep[i] = !Consts[i];
+      return Keep;
+    }
+
+    static unsigned getInstructionCount(Function &F) {
+      unsigned Count = 0;
+      for (BasicBlock &BB : F)
+        Count += BB.size();
+      return Count;
+    }
+
+    // eraseFunction - Delete the now unused F and forget everything the
+    // pass still remembers about it.
+    void eraseFunction(Function *F) {
+      for (Argument &A : F->args()) {
+        argStates.erase(&A);
+        constantArgs.erase(&A);
+        consumerSet.erase(&A);
+        readOnlyArgs.erase(&A);
+      }
+      returnStates.erase(F);
+      for (auto I = returnFieldStates.begin(); I != returnFieldStates.end();) {
+        if (I->first.first == F)
+          returnFieldStates.erase(I++);
+        else
+          ++I;
+      }
+      dirtyFunctions.erase(F);
+      for (auto I = specializations.begin(); I != specializations.end();) {
+        if (I->first.first == F || I->second == F)
+          specializations.erase(I++);
+        else
+          ++I;
+      }
+      F->eraseFromParent();
+    }
+
     /// PropagateConstantsIntoArguments - Look at all uses of the specified
     /// function.  If all uses are direct call sites, and all pass a particular
     /// constant in for an argument, propagate that constant in as the argument.
@@ -113,51 +3541,50 @@ namespace {
       llvm::Function *F = formal_param->getParent();
       llvm::Instruction *formalParamInst;
       int position = formal_param->getArgNo();
-      //errs() << *F << '\n';
-      //errs() << position << '\n';
 
       std::pair<Constant*, bool> argConst;
       argConst.second = true;
-      for (Use &U : F->uses()) {
-        User *UR = U.getUser();
-        // Ignore blockaddress uses.
-        if (isa<BlockAddress>(UR)) continue;
-        
-        // Used by a non-instruction, or not the callee of a function, do not
-        // transform.
-        if (!isa<CallInst>(UR) && !isa<InvokeInst>(UR))
-          return false;
-        
-        CallSite CS(cast<Instruction>(UR));
-        if (!CS.isCallee(&U))
-          return false;
 
-        // Check out all of the potentially constant arguments.  Note that we don't
-        // inspect varargs here.
-        CallSite::arg_iterator AI = CS.arg_begin();
-        CallSite::arg_iterator AE = CS.arg_end();
-        Function::arg_iterator Arg = F->arg_begin();
+      // Calls from outside the module are not seen here.
+      if (!F->hasLocalLinkage()) {
+        remarkMissedArgument(formal_param, "the function is not internal");
+        return false;
+      }
 
-        for (int i = 0; AI != AE; i++, ++AI, ++Arg) {
-          if(i == position) {
-             // If this argument is known non-constant, ignore it.
-            if (!argConst.second) {
-              continue;
-            }
-            
-            Constant *C = dyn_cast<Constant>(*AI);
-            if (C && argConst.first == nullptr) {
-              argConst.first = C;   // First constant seen.
-              argConst.second = true;
-            } else if (C && argConst.first == C) {
-              // Still the constant value we think it is.
-            } else if (*AI == &*Arg) {
-              // Ignore recursive calls passing argument down.
-            } else {
-              // Argument is not constant
-              argConst.second = false;
-            }
-          }
+      // Every call that can reach F, directly or through a function pointer
+      // traced to it. If F's address escapes anywhere else, do not transform.
+      std::vector<CallEdge> sites;
+      if (!getCallSites(F, sites)) {
+        remarkMissedArgument(formal_param, "the address of the function "
+                                           "escapes");
+        return false;
+      }
+
+      for (CallEdge &E : sites) {
+        // If this argument is known non-constant, ignore it.
+        if (!argConst.second)
+          break;
+
+        // A broker may supply the argument itself, which is never constant.
+        Value *Actual = E.getActual(position);
+        if (!Actual) {
+          argConst.second = false;
+          continue;
+        }
+
+        // At -O0 the actual is a reload of a local; use what was stored.
+        Actual = AllocaForwarding::forwardedValue(Actual);
+        Constant *C = dyn_cast<Constant>(Actual);
+        if (C && argConst.first == nullptr) {
+          argConst.first = C;   // First constant seen.
+          argConst.second = true;
+        } else if (C && argConst.first == C) {
+          // Still the constant value we think it is.
+        } else if (Actual == formal_param) {
+          // Ignore recursive calls passing argument down.
+        } else {
+          // Argument is not constant
+          argConst.second = false;
         }
       }
 
@@ -166,48 +3593,44 @@ namespace {
       // Do we have a constant argument?
       if (!argConst.second || formal_param->use_empty() ||
           formal_param->hasInAllocaAttr() || (formal_param->hasByValAttr() && !F->onlyReadsMemory())) {
+        if (!argConst.second)
+          remarkMissedArgument(formal_param, "calls pass different values");
         return false;
       }
 
       // Yay! it's constant!
       Value *V = argConst.first;
       if (!V) V = UndefValue::get(formal_param->getType());
+      remarkConstantArgument(formal_param, V);
       formal_param->replaceAllUsesWith(V);
+      dirtyFunctions.insert(F);
+      constantArgs.insert(formal_param);
       
       return true;
     }
 
-    bool ifInstructionSeen(llvm::Instruction * inst, std::vector<llvm::Instruction *> seen_list){
-      for(int i=0; i < seen_list.size(); ++i){
-        if(inst->isIdenticalTo(seen_list[i])){
-          return true;
-        }  
-      }
-      return false;
-    }
-
-
+    // getConsumers - Add to the consumer set of formal_param the formals
+    // that v, which carries its value, is passed to. Visited holds the
+    // values already followed from formal_param.
     void getConsumers(llvm::Value * v, Function * F, llvm::Argument * formal_param,
-                  std::vector<llvm::Instruction*> seen_inst){
+                  std::set<llvm::Value*> &Visited,
+                  const AllocaForwarding &Fwd){
+      if (!spend())
+        return;
+      FunctionCost *Cost = getCost(F);
+      if (Cost)
+        ++Cost->ConsumerVisits;
       
-      if(Instruction * test = dyn_cast<Instruction>(v)){
-        if(ifInstructionSeen(test, seen_inst)){
-         return;  
-        }
-        else{
-          seen_inst.push_back(test);  
-        }
-      }         
+      if (!Visited.insert(v).second)
+        return;
 
       for( User * U : v->users()){
         if (Instruction *Inst = dyn_cast<Instruction>(U)) {
-            //errs() <<"Lolz " << *Inst << "\n";
 
           // The instruction is a call site, so look to find the actual param
           // that the relation exists on and add it to the formal params consumer set
           if (Inst->getOpcode() == Instruction::Call) {
             CallSite CS(Inst);
-            //errs() << "CallInst: " <<*Inst << "\n";
             Instruction * previous = dyn_cast<Instruction>(v);
             if (previous) {
 
@@ -217,26 +3640,33 @@ namespace {
             }
 
             // if (Instruction * previous = dyn_cast<Instruction>(v)) {
-              //errs() <<"Previous: " << *previous << '\n';
                       
-              CallSite::arg_iterator AI = CS.arg_begin();
-              CallSite::arg_iterator AE = CS.arg_end();
-              Function * defined_func = CS.getCalledFunction();
-              Function::arg_iterator FI = defined_func->arg_begin();
+              // An indirect call feeds every target traced to it; one
+              // that could not be resolved has no known consumers.
+              for (CallEdge &E : getCallees(CS)) {
+                Function::arg_iterator FI = E.Callee->arg_begin();
+                Function::arg_iterator FE = E.Callee->arg_end();
 
-              for(;AI != AE; ++AI, ++FI){
-                llvm::Value *arg_val = dyn_cast<llvm::Value>(AI);
+                // Varargs beyond the last formal have no consumer, nor do
+                // the formals a broker fills in itself.
+                for(unsigned i = 0; FI != FE; ++i, ++FI){
+                  Value *AI = E.getActual(i);
+                  if (!AI)
+                    continue;
+                  if(llvm::Instruction * cs_arg = dyn_cast<llvm::Instruction>(AI)){
 
-                if(llvm::Instruction * cs_arg = dyn_cast<llvm::Instruction>(*AI)){
-
-                  if(cs_arg->isIdenticalTo(previous)){
-                    //errs() <<"Doing the check for prev and callsite arg" << '\n';
+                    if(cs_arg->isIdenticalTo(previous)){
+                      consumerSet[formal_param].push_back(FI); 
+                      if (Cost)
+                        ++Cost->ConsumerEdges;
+                    }
+                  }
+                  else {
                     consumerSet[formal_param].push_back(FI); 
+                    if (Cost)
+                      ++Cost->ConsumerEdges;
                   }
                 }
-                else {
-                  consumerSet[formal_param].push_back(FI); 
-                }
               }
             // }
             //test2.c
@@ -244,25 +3674,41 @@ namespace {
           }
 
           else if(Inst->getOpcode() == Instruction::Ret){
-             //errs() << "Exiting\n";
             return;
           } 
 
           if(Inst->getOpcode() == Instruction::Store){
-            Value * operand = dyn_cast<Value>(Inst->getOperand(1));
-            getConsumers(operand,F,formal_param,seen_inst);    
+            StoreInst * store = cast<StoreInst>(Inst);
+            // Writing through v passes nothing on.
+            if (store->getValueOperand() != v)
+              continue;
+            // v spilled to a local that never escapes: only the loads this
+            // store reaches can see it, so don't chase every use of the slot.
+            if (Fwd.tracks(store->getPointerOperand())) {
+              if (const std::vector<LoadInst*> *readers = Fwd.getReaders(store))
+                for (LoadInst *reader : *readers)
+                  getConsumers(reader,F,formal_param,Visited,Fwd);
+            }
+            // No global is tracked yet when ipconstprop runs, so nothing
+            // loaded from one folds to a constant. Following every load of
+            // a global from every formal stored to it would take time
+            // quadratic in the module and find no consumer that matters.
+            else if (!isa<Constant>(store->getPointerOperand())) {
+              Value * operand = dyn_cast<Value>(Inst->getOperand(1));
+              getConsumers(operand,F,formal_param,Visited,Fwd);
+            }
           }
 
           else if(Inst->getOpcode() == Instruction::Load){
             Value * load = dyn_cast<Value>(Inst);
             
-            getConsumers(load,F,formal_param,seen_inst);   
+            getConsumers(load,F,formal_param,Visited,Fwd);   
           }
           
           else{
             //Value * v1 = dyn_cast<Value>(U);
             Value * other = dyn_cast<Value>(Inst);
-            getConsumers(other,F,formal_param,seen_inst);
+            getConsumers(other,F,formal_param,Visited,Fwd);
             
           }
         }
@@ -285,26 +3731,28 @@ namespace {
       }
       
       for(Module::iterator F=M.begin(), E=M.end(); F != E ; ++F){
+        if (budget.isExhausted()) {
+          ++skippedConsumerFunctions;
+          continue;
+        }
         
-        //errs() << "Name of Function: " << F->getName() << '\n' << '\n';
         
         bool has_callInst = false;
         for (inst_iterator I = inst_begin(*F), E = inst_end(*F); I != E; ++I){ 
           if (CallInst* callInst = dyn_cast<CallInst>(&*I)) {
             has_callInst =true;
-            //errs() << F->getName() << " has at least one call instruction" << '\n';
           }
         }
 
         if(has_callInst){ 
+          AllocaForwarding Fwd(*F);
           Function::arg_iterator Foo_args_begin = F->arg_begin();
           Function::arg_iterator Foo_args_end = F->arg_end();
           for(; Foo_args_begin != Foo_args_end; ++Foo_args_begin){
             Value * v = dyn_cast<llvm::Value>(Foo_args_begin);
-            //errs() << "Arg: " << *v<< '\n';
-            std::vector<llvm::Instruction*> seen_list;
-            getConsumers(v,&(*F),Foo_args_begin,seen_list);   
-            seen_list.clear();    
+            std::set<llvm::Value*> Visited;
+            CostTimer Timer(getCost(&*F));
+            getConsumers(v,&(*F),Foo_args_begin,Visited,Fwd);
           }
           /*
           // Print out function body if it contains a callsite
@@ -322,40 +3770,132 @@ namespace {
     }
     
 
-  bool ConstantPropagation(Function &F) {
-    // Initialize the worklist to all of the instructions ready to process...
-    std::set<Instruction*> WorkList;
-    for(inst_iterator i = inst_begin(F), e = inst_end(F); i != e; ++i) {
-       WorkList.insert(&*i);
+  // pruneSwitch - Delete the cases of SI that no constant in CondV selects.
+  // When every constant has its own case the default is unreachable too.
+  bool pruneSwitch(SwitchInst *SI, const LatticeVal &CondV) {
+    BasicBlock *BB = SI->getParent();
+    bool Changed = false;
+    unsigned NumMatched = 0;
+    for (SwitchInst::CaseIt i = SI->case_end(), e = SI->case_begin();
+         i-- != e;) {
+      if (CondV.contains(i.getCaseValue())) {
+        ++NumMatched;
+        continue;
+      }
+      i.getCaseSuccessor()->removePredecessor(BB);
+      SI->removeCase(i);
+      ++NumCasesRemoved;
+      Changed = true;
+    }
+
+    if (NumMatched == CondV.Values.size() &&
+        !isa<UnreachableInst>(SI->getDefaultDest()->getFirstNonPHI())) {
+      LLVMContext &Ctx = SI->getContext();
+      BasicBlock *Unreachable = BasicBlock::Create(Ctx, "default.unreachable",
+                                                   BB->getParent());
+      new UnreachableInst(Ctx, Unreachable);
+      SI->getDefaultDest()->removePredecessor(BB);
+      SI->setDefaultDest(Unreachable);
+      Changed = true;
     }
+    return Changed;
+  }
+
+  /// ConstantPropagation - Solve F with FunctionSolver, then commit: replace
+  /// every value proven constant, fold branches on constant conditions and
+  /// delete the blocks that can no longer execute.
+  bool ConstantPropagation(Function &F) {
+    if (F.isDeclaration())
+      return false;
+    PhaseScope Scope("constant-propagation", isSubPhaseTimingEnabled());
+    spend();
+    TraceSpan Span(F.getName(), "fold");
+    FunctionCost *Cost = getCost(&F);
+    CostTimer Timer(Cost);
+
     bool Changed = false;
     const DataLayout &DL = F.getParent()->getDataLayout();
     TargetLibraryInfo *TLI =
       &getAnalysis<TargetLibraryInfoWrapperPass>().getTLI();
 
-    while (!WorkList.empty()) {
-      Instruction *I = *WorkList.begin();
-      WorkList.erase(WorkList.begin());    // Get an element from the worklist...
+    FunctionSolver Solver(DL, TLI, &argStates, &returnStates, &globalStates,
+                          &returnFieldStates);
+    Solver.solve(F);
 
-      if (!I->use_empty())                 // Don't muck with dead instructions...
-        if (Constant *C = ConstantFoldInstruction(I, DL, TLI)) {
-         // Add all of the users of this instruction to the worklist, they might
-         // be constant propagatable now...
-         for (User *U : I->users())
-           WorkList.insert(cast<Instruction>(U));
+    std::vector<BasicBlock*> DeadBlocks;
+    for (BasicBlock &BB : F) {
+      if (!Solver.isBlockExecutable(&BB)) {
+        DeadBlocks.push_back(&BB);
+        continue;
+      }
 
-          // Replace all of the uses of a variable with uses of the constant.
-          I->replaceAllUsesWith(C);
+      for (BasicBlock::iterator BI = BB.begin(), BE = BB.end(); BI != BE;) {
+        Instruction *I = &*BI++;
+        if (isa<TerminatorInst>(I) || I->use_empty())
+          continue;
+        Constant *C = Solver.getValueState(I).getConstant();
+        if (!C)
+          continue;
 
-          // Remove the dead instruction.
-          WorkList.erase(I);
-          I->eraseFromParent();
+        if (remarksEnabled)
+          if (CallInst *CI = dyn_cast<CallInst>(I)) {
+            Remark R(true, "CallFolded", F, CI->getDebugLoc());
+            R << "call";
+            if (Function *Callee = CI->getCalledFunction()) {
+              R << " to ";
+              R.arg("Callee", Callee);
+            }
+            R << " always returns ";
+            emitRemark(R.arg("Constant", C));
+          }
 
-          // We made a change to the function...
-          Changed = true;
+        // Replace all of the uses of a variable with uses of the constant.
+        I->replaceAllUsesWith(C);
+        if (Cost)
+          ++Cost->Folded;
+        if (isInstructionTriviallyDead(I, TLI)) {
+          I->eraseFromParent();
           ++NumInstKilled;
         }
+        Changed = true;
+      }
+    }
+
+    // Branches on the conditions folded above now have a constant operand;
+    // turn them into unconditional branches so the dead blocks lose their
+    // live predecessors.
+    for (BasicBlock &BB : F)
+      if (Solver.isBlockExecutable(&BB))
+        Changed |= ConstantFoldTerminator(&BB, true, TLI);
+
+    // A switch on a set of constants keeps only the cases the set selects.
+    for (BasicBlock &BB : F) {
+      if (!Solver.isBlockExecutable(&BB))
+        continue;
+      SwitchInst *SI = dyn_cast<SwitchInst>(BB.getTerminator());
+      if (!SI)
+        continue;
+      LatticeVal CondV = Solver.getValueState(SI->getCondition());
+      if (CondV.isConstantSet() && FunctionSolver::allConstantInts(CondV))
+        Changed |= pruneSwitch(SI, CondV);
     }
+
+    for (BasicBlock *BB : DeadBlocks) {
+      for (succ_iterator SI = succ_begin(BB), SE = succ_end(BB); SI != SE; ++SI)
+        (*SI)->removePredecessor(BB);
+      BB->dropAllReferences();
+    }
+    for (BasicBlock *BB : DeadBlocks) {
+      for (Instruction &I : *BB)
+        if (!I.use_empty())
+          I.replaceAllUsesWith(UndefValue::get(I.getType()));
+      BB->eraseFromParent();
+      ++NumBlocksRemoved;
+      Changed = true;
+    }
+
+    if (Changed)
+      dirtyFunctions.insert(&F);
     return Changed;
   }
    
@@ -0,0 +1,46 @@
+//===- HelloPhases.h - Phase times of the hello pass ------------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Lets tools that link the hello pass in, such as the compile-time
+// benchmark, see how long each of its phases took and how much memory
+// they used.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef HELLO_HELLOPHASES_H
+#define HELLO_HELLOPHASES_H
+
+#include <cstdint>
+#include <vector>
+
+namespace hello {
+
+/// PhaseTime - The time and memory one phase of the hello pass took. A
+/// phase that runs in many pieces, such as propagation into one function,
+/// adds up all of them. MallocBytes is the net growth of the heap across
+/// the phase; PeakRSSBytes is the process's resident high-water mark when
+/// it ended.
+struct PhaseTime {
+  const char *Name;
+  unsigned Pieces;
+  double WallSeconds;
+  double UserSeconds;
+  double SystemSeconds;
+  int64_t MallocBytes;
+  uint64_t PeakRSSBytes;
+};
+
+/// getLastRunPhaseTimes - The phases of the most recent run of the hello
+/// pass, in the order they first ran. Phases that run in many pieces are
+/// only timed with -time-passes or -hello-time-report.
+const std::vector<PhaseTime> &getLastRunPhaseTimes();
+
+} // end namespace hello
+
+#endif
@@ -0,0 +1,203 @@
+//===- HelloBench.cpp - Compile-time scaling of the hello pass ------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Generates synthetic modules over a sweep of one dimension of their call
+// graph, runs the hello pass on each in-process and writes how long every
+// phase took as CSV, one row per phase and run:
+//
+//   knob,value,run,functions,instructions,phase,seconds
+//
+// Options of the hello pass itself (-hello-specialize and so on) can be
+// given too, since the pass is linked in.
+//
+//===----------------------------------------------------------------------===//
+
+#include "../HelloPhases.h"
+#include "../gen/SyntheticModule.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/InitializePasses.h"
+#include "llvm/Pass.h"
+#include "llvm/PassRegistry.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <string>
+
+using namespace llvm;
+
+static cl::opt<std::string> OutputFilename("o", cl::init("-"),
+    cl::value_desc("filename"), cl::desc("Where to write the CSV"));
+
+static cl::opt<std::string> SweepKnob("sweep", cl::init("roots"),
+    cl::desc("Dimension to sweep: functions, depth, roots, fan-out, fan-in, "
+             "args, body, constant-percent, cycles or chains"));
+
+static cl::list<unsigned> SweepValues("values", cl::CommaSeparated,
+    cl::desc("Values the swept dimension takes (default 4,16,64,256,1024)"));
+
+static cl::opt<unsigned> Runs("runs", cl::init(3),
+    cl::desc("Runs per value, each on a freshly generated module"));
+
+static cl::opt<unsigned> Seed("seed", cl::init(1),
+    cl::desc("Seed of the module of the first run; run N uses seed + N"));
+
+static cl::opt<std::string> Shape("shape", cl::init("layered"),
+    cl::desc("Call graph: layered or random"));
+
+static cl::opt<unsigned> Functions("functions", cl::init(1000),
+    cl::desc("Internal functions of a random call graph"));
+static cl::opt<unsigned> Depth("depth", cl::init(8),
+    cl::desc("Levels of the call graph"));
+static cl::opt<unsigned> Roots("roots", cl::init(4),
+    cl::desc("Functions in the first level"));
+static cl::opt<unsigned> FanOut("fan-out", cl::init(2),
+    cl::desc("Calls each function makes into the next level"));
+static cl::opt<unsigned> FanIn("fan-in", cl::init(2),
+    cl::desc("Calls each function receives from the level above"));
+static cl::opt<unsigned> MaxWidth("max-width", cl::init(1024),
+    cl::desc("Most functions in one level"));
+static cl::opt<unsigned> Args("args", cl::init(3),
+    cl::desc("Formals per function"));
+static cl::opt<unsigned> BodySize("body", cl::init(16),
+    cl::desc("Arithmetic instructions per function"));
+static cl::opt<unsigned> ConstantPercent("constant-percent", cl::init(67),
+    cl::desc("Share of actuals, in percent, that are literals"));
+static cl::opt<unsigned> Cycles("cycles", cl::init(0),
+    cl::desc("Calls back to earlier functions, forming recursion cycles"));
+static cl::opt<unsigned> Chains("chains", cl::init(0),
+    cl::desc("Straight-line functions like massive_compute"));
+static cl::opt<unsigned> ChainSize("chain-size", cl::init(10000),
+    cl::desc("Instructions of each straight-line function"));
+
+// getKnob - The field of Config the name of a swept dimension selects.
+static unsigned *getKnob(hello::SyntheticConfig &Config, StringRef Name) {
+  if (Name == "functions")
+    return &Config.Functions;
+  if (Name == "depth")
+    return &Config.Depth;
+  if (Name == "roots")
+    return &Config.Roots;
+  if (Name == "fan-out")
+    return &Config.FanOut;
+  if (Name == "fan-in")
+    return &Config.FanIn;
+  if (Name == "args")
+    return &Config.Args;
+  if (Name == "body")
+    return &Config.BodySize;
+  if (Name == "constant-percent")
+    return &Config.ConstantPercent;
+  if (Name == "cycles")
+    return &Config.RecursionCycles;
+  if (Name == "chains")
+    return &Config.StraightLineFunctions;
+  return nullptr;
+}
+
+static unsigned getInstructionCount(Module &M) {
+  unsigned Count = 0;
+  for (Function &F : M)
+    for (BasicBlock &BB : F)
+      Count += BB.size();
+  return Count;
+}
+
+static double getWallTime() {
+  return TimeRecord::getCurrentTime(true).getWallTime();
+}
+
+int main(int argc, char **argv) {
+  PassRegistry &Registry = *PassRegistry::getPassRegistry();
+  initializeCore(Registry);
+  initializeAnalysis(Registry);
+  initializeTransformUtils(Registry);
+  initializeScalarOpts(Registry);
+  initializeInstCombine(Registry);
+  cl::ParseCommandLineOptions(argc, argv,
+                              "hello pass compile-time benchmark\n");
+
+  const PassInfo *HelloInfo = Registry.getPassInfo(StringRef("hello"));
+  if (!HelloInfo) {
+    errs() << argv[0] << ": the hello pass is not linked in\n";
+    return 1;
+  }
+
+  hello::SyntheticConfig Config;
+  if (Shape == "random")
+    Config.Shape = hello::SyntheticConfig::RandomDAG;
+  else if (Shape != "layered") {
+    errs() << argv[0] << ": unknown shape '" << Shape << "'\n";
+    return 1;
+  }
+  Config.Functions = Functions;
+  Config.Depth = Depth;
+  Config.Roots = Roots;
+  Config.FanOut = FanOut;
+  Config.FanIn = FanIn;
+  Config.MaxWidth = MaxWidth;
+  Config.Args = Args;
+  Config.BodySize = BodySize;
+  Config.ConstantPercent = ConstantPercent;
+  Config.RecursionCycles = Cycles;
+  Config.StraightLineFunctions = Chains;
+  Config.StraightLineSize = ChainSize;
+  unsigned *Knob = getKnob(Config, SweepKnob);
+  if (!Knob) {
+    errs() << argv[0] << ": unknown dimension '" << SweepKnob << "'\n";
+    return 1;
+  }
+
+  std::vector<unsigned> Values(SweepValues.begin(), SweepValues.end());
+  if (Values.empty())
+    Values = { 4, 16, 64, 256, 1024 };
+
+  std::error_code EC;
+  raw_fd_ostream Out(OutputFilename, EC, sys::fs::F_Text);
+  if (EC) {
+    errs() << argv[0] << ": " << OutputFilename << ": " << EC.message()
+           << '\n';
+    return 1;
+  }
+  Out << "knob,value,run,functions,instructions,phase,seconds\n";
+
+  for (unsigned Value : Values) {
+    *Knob = Value;
+    for (unsigned Run = 0; Run != Runs; ++Run) {
+      Config.Seed = Seed + Run;
+      LLVMContext Ctx;
+      double Start = getWallTime();
+      std::unique_ptr<Module> M = hello::buildSyntheticModule(Ctx, Config);
+      double Generated = getWallTime();
+
+      std::string Row;
+      raw_string_ostream(Row) << SweepKnob << ',' << Value << ',' << Run
+                              << ',' << M->size() << ','
+                              << getInstructionCount(*M) << ',';
+
+      legacy::PassManager PM;
+      PM.add(new TargetLibraryInfoWrapperPass(Triple(M->getTargetTriple())));
+      PM.add(HelloInfo->createPass());
+      PM.run(*M);
+      double Done = getWallTime();
+
+      Out << Row << "generate," << Generated - Start << '\n';
+      for (const hello::PhaseTime &Phase : hello::getLastRunPhaseTimes())
+        Out << Row << Phase.Name << ',' << Phase.WallSeconds << '\n';
+      Out << Row << "total," << Done - Generated << '\n';
+      Out.flush();
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,280 @@
+//===- HelloFuzz.cpp - Differential fuzzing of the hello pass -------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Checks the hello pass against random modules in two ways:
+//
+//  * Semantics. Each seed picks a random small shape for the generator of
+//    SyntheticModule.h. The module is run through the pass, and the
+//    interpreter runs synthetic_main of the original and of the transformed
+//    module on a few inputs. The results must agree. Generated modules only
+//    wrap integers and bound their recursion, so every run is well defined
+//    and returns. Besides i32 arithmetic, branches and direct calls, most
+//    seeds use the generator's idioms: switches, internal globals, pointers
+//    to local slots, a struct return and calls through a function-pointer
+//    formal. Callback brokers and byval formals are not generated: the
+//    brokers are C library functions the interpreter cannot call into.
+//
+//  * Scaling. For some seeds the same shape is grown by doubling its
+//    number of functions, and the pass is timed at each size. When the
+//    slope of log time against log size goes past -max-slope, the pass grew
+//    faster than linearly and the seed is reported.
+//
+// Failing modules are written out as <prefix><seed>.ll so that they can be
+// replayed with opt. Options of the pass itself can be given, for example
+// -hello-specialize, to fuzz the transformations they enable.
+//
+//===----------------------------------------------------------------------===//
+
+#include "../gen/SyntheticModule.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/ExecutionEngine/GenericValue.h"
+#include "llvm/ExecutionEngine/Interpreter.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/InitializePasses.h"
+#include "llvm/Pass.h"
+#include "llvm/PassRegistry.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+static cl::opt<unsigned> Iterations("iterations", cl::init(100),
+    cl::desc("Random modules to check"));
+
+static cl::opt<unsigned> FirstSeed("seed", cl::init(1),
+    cl::desc("Seed of the first module; the others follow it"));
+
+static cl::list<int> Inputs("inputs", cl::CommaSeparated,
+    cl::desc("Arguments synthetic_main is run with (default 0,1,2); they "
+             "bound the recursion, whose runs grow exponentially in them"));
+
+static cl::opt<unsigned> ScalingEvery("scaling-every", cl::init(10),
+    cl::desc("Check the scaling of every Nth seed; 0 disables it"));
+
+static cl::opt<unsigned> ScalingBase("scaling-base", cl::init(250),
+    cl::desc("Functions of the smallest module of a scaling check"));
+
+static cl::opt<unsigned> ScalingSteps("scaling-steps", cl::init(4),
+    cl::desc("Sizes of a scaling check, each twice the one before"));
+
+static cl::opt<double> MaxSlope("max-slope", cl::init(1.3),
+    cl::desc("Largest slope of log time over log size taken as linear"));
+
+static cl::opt<double> MinSeconds("min-seconds", cl::init(0.05),
+    cl::desc("Scaling checks whose largest module takes less are noise"));
+
+static cl::opt<std::string> FailurePrefix("failure-prefix",
+    cl::init("hello-fuzz-"),
+    cl::desc("Where to write the modules of failing seeds"));
+
+// getSemanticsConfig - A small random shape: small enough, and with few
+// enough paths through its calls, that the interpreter runs it quickly.
+static hello::SyntheticConfig getSemanticsConfig(unsigned Seed) {
+  std::mt19937 Rng(Seed);
+  hello::SyntheticConfig Config;
+  Config.Seed = Seed;
+  if (Rng() % 2) {
+    Config.Shape = hello::SyntheticConfig::RandomDAG;
+    Config.FanOut = 1 + Rng() % 2;
+    Config.Functions = 2 + Rng() % (Config.FanOut == 1 ? 24 : 10);
+  } else {
+    Config.Shape = hello::SyntheticConfig::Layered;
+    Config.Depth = 1 + Rng() % 5;
+    Config.FanOut = 1 + Rng() % 2;
+    Config.FanIn = 1 + Rng() % 2;
+    Config.MaxWidth = 8;
+  }
+  Config.Roots = 1 + Rng() % 3;
+  Config.Args = 1 + Rng() % 4;
+  Config.BodySize = Rng() % 9;
+  Config.ConstantPercent = Rng() % 101;
+  Config.RecursionCycles = Rng() % 3;
+  Config.StraightLineFunctions = Rng() % 2;
+  Config.StraightLineSize = 5 + Rng() % 50;
+  Config.IdiomPercent = Rng() % 4 ? Rng() % 101 : 0;
+  return Config;
+}
+
+static unsigned getInstructionCount(Module &M) {
+  unsigned Count = 0;
+  for (Function &F : M)
+    for (BasicBlock &BB : F)
+      Count += BB.size();
+  return Count;
+}
+
+// runPass - Run the hello pass over M, returning how long it took.
+static double runPass(const PassInfo *HelloInfo, Module &M) {
+  legacy::PassManager PM;
+  PM.add(new TargetLibraryInfoWrapperPass(Triple(M.getTargetTriple())));
+  PM.add(HelloInfo->createPass());
+  double Start = TimeRecord::getCurrentTime(true).getWallTime();
+  PM.run(M);
+  return TimeRecord::getCurrentTime(false).getWallTime() - Start;
+}
+
+// execute - The results of synthetic_main on each input, run by the
+// interpreter; false if M cannot be run.
+static bool execute(std::unique_ptr<Module> M, const std::vector<int> &Args,
+                    std::vector<int64_t> &Results, std::string &Err) {
+  Module *Mod = M.get();
+  std::unique_ptr<ExecutionEngine> EE(EngineBuilder(std::move(M))
+                                        .setErrorStr(&Err)
+                                        .setEngineKind(EngineKind::Interpreter)
+                                        .create());
+  if (!EE)
+    return false;
+  Function *Main = Mod->getFunction("synthetic_main");
+  if (!Main) {
+    Err = "synthetic_main is gone";
+    return false;
+  }
+  for (int Arg : Args) {
+    GenericValue In;
+    In.IntVal = APInt(32, uint64_t(int64_t(Arg)), true);
+    GenericValue Out = EE->runFunction(Main, In);
+    Results.push_back(Out.IntVal.getSExtValue());
+  }
+  return true;
+}
+
+static void writeFailure(Module &M, unsigned Seed) {
+  std::string Filename = FailurePrefix + std::to_string(Seed) + ".ll";
+  std::error_code EC;
+  raw_fd_ostream Out(Filename, EC, sys::fs::F_Text);
+  if (EC) {
+    errs() << "  cannot write " << Filename << ": " << EC.message() << '\n';
+    return;
+  }
+  M.print(Out, nullptr);
+  errs() << "  module written to " << Filename << '\n';
+}
+
+// checkSemantics - Whether the pass keeps what the module of Seed computes.
+static bool checkSemantics(const PassInfo *HelloInfo, unsigned Seed,
+                           const std::vector<int> &Args) {
+  LLVMContext Ctx;
+  std::unique_ptr<Module> Original =
+    hello::buildSyntheticModule(Ctx, getSemanticsConfig(Seed));
+  std::unique_ptr<Module> Transformed = CloneModule(Original.get());
+  runPass(HelloInfo, *Transformed);
+
+  std::string Err;
+  if (verifyModule(*Transformed, &errs())) {
+    errs() << "seed " << Seed << ": the pass produced an invalid module\n";
+    writeFailure(*Original, Seed);
+    return false;
+  }
+
+  std::unique_ptr<Module> Reference = CloneModule(Original.get());
+  std::vector<int64_t> Expected, Actual;
+  if (!execute(std::move(Reference), Args, Expected, Err) ||
+      !execute(std::move(Transformed), Args, Actual, Err)) {
+    errs() << "seed " << Seed << ": cannot interpret: " << Err << '\n';
+    writeFailure(*Original, Seed);
+    return false;
+  }
+  for (unsigned i = 0, e = Args.size(); i != e; ++i)
+    if (Expected[i] != Actual[i]) {
+      errs() << "seed " << Seed << ": synthetic_main(" << Args[i]
+             << ") returned " << Actual[i] << " after the pass, "
+             << Expected[i] << " before\n";
+      writeFailure(*Original, Seed);
+      return false;
+    }
+  return true;
+}
+
+// checkScaling - Whether the pass time of the shape of Seed grows about
+// linearly as its number of functions doubles.
+static bool checkScaling(const PassInfo *HelloInfo, unsigned Seed) {
+  hello::SyntheticConfig Config = getSemanticsConfig(Seed);
+  Config.Shape = hello::SyntheticConfig::RandomDAG;
+
+  std::vector<double> LogSizes, LogTimes;
+  double Largest = 0;
+  for (unsigned Step = 0; Step != ScalingSteps; ++Step) {
+    Config.Functions = ScalingBase << Step;
+    LLVMContext Ctx;
+    std::unique_ptr<Module> M = hello::buildSyntheticModule(Ctx, Config);
+    double Size = getInstructionCount(*M);
+    double Seconds = std::max(runPass(HelloInfo, *M), 1e-6);
+    LogSizes.push_back(std::log(Size));
+    LogTimes.push_back(std::log(Seconds));
+    Largest = Seconds;
+  }
+  if (LogSizes.size() < 2 || Largest < MinSeconds)
+    return true;
+
+  // Least squares fit of log time = Slope * log size + c.
+  double N = LogSizes.size(), SumX = 0, SumY = 0, SumXX = 0, SumXY = 0;
+  for (unsigned i = 0, e = LogSizes.size(); i != e; ++i) {
+    SumX += LogSizes[i];
+    SumY += LogTimes[i];
+    SumXX += LogSizes[i] * LogSizes[i];
+    SumXY += LogSizes[i] * LogTimes[i];
+  }
+  double Slope = (N * SumXY - SumX * SumY) / (N * SumXX - SumX * SumX);
+  if (Slope <= MaxSlope)
+    return true;
+
+  errs() << "seed " << Seed << ": pass time grows as size^" << Slope
+         << " from " << ScalingBase << " to "
+         << (ScalingBase << (ScalingSteps - 1)) << " functions\n";
+  LLVMContext Ctx;
+  Config.Functions = ScalingBase;
+  writeFailure(*hello::buildSyntheticModule(Ctx, Config), Seed);
+  return false;
+}
+
+int main(int argc, char **argv) {
+  PassRegistry &Registry = *PassRegistry::getPassRegistry();
+  initializeCore(Registry);
+  initializeAnalysis(Registry);
+  initializeTransformUtils(Registry);
+  initializeScalarOpts(Registry);
+  initializeInstCombine(Registry);
+  cl::ParseCommandLineOptions(argc, argv,
+                              "differential fuzzer of the hello pass\n");
+
+  const PassInfo *HelloInfo = Registry.getPassInfo(StringRef("hello"));
+  if (!HelloInfo) {
+    errs() << argv[0] << ": the hello pass is not linked in\n";
+    return 1;
+  }
+
+  std::vector<int> Args(Inputs.begin(), Inputs.end());
+  if (Args.empty())
+    Args = { 0, 1, 2 };
+
+  unsigned Failures = 0;
+  for (unsigned i = 0; i != Iterations; ++i) {
+    unsigned Seed = FirstSeed + i;
+    if (!checkSemantics(HelloInfo, Seed, Args))
+      ++Failures;
+    if (ScalingEvery && i % ScalingEvery == 0 &&
+        !checkScaling(HelloInfo, Seed))
+      ++Failures;
+  }
+  errs() << Iterations << " seeds, " << Failures << " failures\n";
+  return Failures ? 1 : 0;
+}
@@ -0,0 +1,109 @@
+//===- HelloMeasure.cpp - Time and peak memory of one command -------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Runs a command, such as one opt invocation, and records how long it took
+// and the most memory it had resident:
+//
+//   hello-measure [-o file] <program> [arguments...]
+//
+// The result is one line, "<wall seconds> <user seconds> <peak RSS in KB>",
+// written to the file or to stderr. The command's own output is untouched
+// and its exit status is passed on. Unlike getrusage(RUSAGE_CHILDREN), the
+// peak is that of this one command, so commands measured one after another
+// do not hide each other.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace llvm;
+
+static cl::opt<std::string> Program(cl::Positional, cl::Required,
+    cl::desc("<program>"));
+
+static cl::list<std::string> ProgramArgs(cl::ConsumeAfter,
+    cl::desc("<program arguments>..."));
+
+static cl::opt<std::string> OutputFilename("o", cl::value_desc("filename"),
+    cl::desc("Write the measurement here instead of stderr"));
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv,
+                              "time and peak memory of one command\n");
+
+#if defined(__unix__) || defined(__APPLE__)
+  std::vector<char *> Args;
+  Args.push_back(const_cast<char *>(Program.c_str()));
+  for (std::string &Arg : ProgramArgs)
+    Args.push_back(const_cast<char *>(Arg.c_str()));
+  Args.push_back(nullptr);
+
+  std::chrono::steady_clock::time_point Start =
+    std::chrono::steady_clock::now();
+  pid_t Child = fork();
+  if (Child < 0) {
+    errs() << argv[0] << ": cannot fork\n";
+    return 1;
+  }
+  if (Child == 0) {
+    execvp(Args[0], Args.data());
+    _exit(127);
+  }
+
+  int Status = 0;
+  struct rusage Usage;
+  if (wait4(Child, &Status, 0, &Usage) != Child) {
+    errs() << argv[0] << ": lost " << Program << '\n';
+    return 1;
+  }
+  double Wall = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - Start).count();
+  double User = Usage.ru_utime.tv_sec + Usage.ru_utime.tv_usec / 1e6;
+#if defined(__APPLE__)
+  uint64_t PeakKB = uint64_t(Usage.ru_maxrss) / 1024;
+#else
+  uint64_t PeakKB = uint64_t(Usage.ru_maxrss);
+#endif
+
+  std::unique_ptr<raw_fd_ostream> File;
+  if (!OutputFilename.empty()) {
+    std::error_code EC;
+    File.reset(new raw_fd_ostream(OutputFilename, EC, sys::fs::F_Text));
+    if (EC) {
+      errs() << argv[0] << ": " << OutputFilename << ": " << EC.message()
+             << '\n';
+      return 1;
+    }
+  }
+  raw_ostream &OS = File ? static_cast<raw_ostream &>(*File) : errs();
+  OS << format("%.6f %.6f %llu\n", Wall, User, (unsigned long long)PeakKB);
+
+  if (WIFEXITED(Status))
+    return WEXITSTATUS(Status);
+  return 128 + (WIFSIGNALED(Status) ? WTERMSIG(Status) : 0);
+#else
+  errs() << argv[0] << ": not supported on this platform\n";
+  return 1;
+#endif
+}
@@ -0,0 +1,286 @@
+//===- HelloSpeedup.cpp - Runtime speedup of code the hello pass built ----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Runs a baseline and an optimized build of one program, alternating so that
+// drift in the machine hits both alike, and reports how much faster the
+// optimized one is:
+//
+//   hello-speedup [options] <baseline> <optimized> [program arguments...]
+//
+// Wall time is always measured. Where perf_event_open is available, the
+// cycles and instructions of each run are counted too, like perf stat.
+// Every metric is reported as its mean over the runs with a 95% confidence
+// interval, along with the speedup, baseline over optimized, and its own
+// interval.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace llvm;
+
+static cl::opt<std::string> Baseline(cl::Positional, cl::Required,
+    cl::desc("<baseline>"));
+
+static cl::opt<std::string> Optimized(cl::Positional, cl::Required,
+    cl::desc("<optimized>"));
+
+static cl::list<std::string> ProgramArgs(cl::ConsumeAfter,
+    cl::desc("<program arguments>..."));
+
+static cl::opt<unsigned> Runs("runs", cl::init(10),
+    cl::desc("Measured runs of each build"));
+
+static cl::opt<unsigned> Warmup("warmup", cl::init(1),
+    cl::desc("Unmeasured runs of each build first"));
+
+static cl::opt<std::string> Name("name",
+    cl::desc("Name of the program in the report (default: the baseline)"));
+
+static cl::opt<std::string> OutputFilename("o", cl::value_desc("filename"),
+    cl::desc("Append the results to this CSV file"));
+
+namespace {
+  /// Counter - One hardware counter of the runs, read with perf_event_open.
+  /// Counters are opened on this process with inherit set, so that a child
+  /// adds its counts to them when it exits.
+  class Counter {
+    int FD;
+
+  public:
+    enum Kind { Cycles, Instructions };
+
+    explicit Counter(Kind K) : FD(-1) {
+#if defined(__linux__)
+      struct perf_event_attr Attr;
+      memset(&Attr, 0, sizeof(Attr));
+      Attr.size = sizeof(Attr);
+      Attr.type = PERF_TYPE_HARDWARE;
+      Attr.config = K == Cycles ? PERF_COUNT_HW_CPU_CYCLES
+                                : PERF_COUNT_HW_INSTRUCTIONS;
+      Attr.disabled = 1;
+      Attr.inherit = 1;
+      Attr.exclude_kernel = 1;
+      Attr.exclude_hv = 1;
+      FD = int(syscall(__NR_perf_event_open, &Attr, 0, -1, -1, 0));
+#else
+      (void)K;
+#endif
+    }
+
+    ~Counter() {
+#if defined(__linux__)
+      if (FD >= 0)
+        close(FD);
+#endif
+    }
+
+    bool isAvailable() const { return FD >= 0; }
+
+    void start() {
+#if defined(__linux__)
+      ioctl(FD, PERF_EVENT_IOC_RESET, 0);
+      ioctl(FD, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+
+    // stop - The count since start, or -1 if it could not be read.
+    double stop() {
+#if defined(__linux__)
+      ioctl(FD, PERF_EVENT_IOC_DISABLE, 0);
+      uint64_t Count;
+      if (read(FD, &Count, sizeof(Count)) == ssize_t(sizeof(Count)))
+        return double(Count);
+#endif
+      return -1;
+    }
+  };
+
+  /// Metric - The samples of one quantity for both builds.
+  struct Metric {
+    const char *Name;
+    std::vector<double> Samples[2];
+  };
+
+  /// Summary - The mean of some samples and the half width of its 95%
+  /// confidence interval.
+  struct Summary {
+    double Mean;
+    double HalfWidth;
+    double Variance;
+  };
+}
+
+// getCriticalT - The two-sided 95% critical value of Student's t with DF
+// degrees of freedom.
+static double getCriticalT(unsigned DF) {
+  static const double Table[] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+  };
+  if (DF == 0)
+    return 0;
+  if (DF <= array_lengthof(Table))
+    return Table[DF - 1];
+  return 1.96;
+}
+
+static Summary summarize(const std::vector<double> &Samples) {
+  Summary S = { 0, 0, 0 };
+  if (Samples.empty())
+    return S;
+  for (double X : Samples)
+    S.Mean += X;
+  S.Mean /= Samples.size();
+  if (Samples.size() < 2)
+    return S;
+  for (double X : Samples)
+    S.Variance += (X - S.Mean) * (X - S.Mean);
+  S.Variance /= Samples.size() - 1;
+  S.HalfWidth = getCriticalT(Samples.size() - 1) *
+                std::sqrt(S.Variance / Samples.size());
+  return S;
+}
+
+// runOnce - Run Program with the program arguments, its output discarded,
+// returning whether it ran and exited with 0.
+static bool runOnce(StringRef Program, std::string &ErrMsg) {
+  std::vector<const char *> Args;
+  Args.push_back(Program.data());
+  for (const std::string &Arg : ProgramArgs)
+    Args.push_back(Arg.c_str());
+  Args.push_back(nullptr);
+
+  StringRef Null("");
+  const StringRef *Redirects[] = { nullptr, &Null, nullptr };
+  bool Failed = false;
+  int Status = sys::ExecuteAndWait(Program, Args.data(), nullptr, Redirects,
+                                   0, 0, &ErrMsg, &Failed);
+  if (!Failed && Status != 0)
+    ErrMsg = "exited with status " + std::to_string(Status);
+  return !Failed && Status == 0;
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv,
+                              "runtime speedup of the hello pass\n");
+
+  Counter Cycles(Counter::Cycles);
+  Counter Instructions(Counter::Instructions);
+  Metric Wall = { "seconds", {} };
+  Metric CycleCounts = { "cycles", {} };
+  Metric InstructionCounts = { "instructions", {} };
+
+  const std::string Programs[] = { Baseline, Optimized };
+  for (unsigned Run = 0, E = Warmup + Runs; Run != E; ++Run) {
+    for (unsigned Build = 0; Build != 2; ++Build) {
+      bool Measured = Run >= Warmup;
+      if (Measured && Cycles.isAvailable())
+        Cycles.start();
+      if (Measured && Instructions.isAvailable())
+        Instructions.start();
+      std::chrono::steady_clock::time_point Start =
+        std::chrono::steady_clock::now();
+
+      std::string ErrMsg;
+      bool OK = runOnce(Programs[Build], ErrMsg);
+
+      double Seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - Start).count();
+      double CycleCount = Measured && Cycles.isAvailable() ?
+        Cycles.stop() : -1;
+      double InstructionCount = Measured && Instructions.isAvailable() ?
+        Instructions.stop() : -1;
+      if (!OK) {
+        errs() << argv[0] << ": " << Programs[Build] << ": " << ErrMsg
+               << '\n';
+        return 1;
+      }
+      if (!Measured)
+        continue;
+      Wall.Samples[Build].push_back(Seconds);
+      if (CycleCount >= 0)
+        CycleCounts.Samples[Build].push_back(CycleCount);
+      if (InstructionCount >= 0)
+        InstructionCounts.Samples[Build].push_back(InstructionCount);
+    }
+  }
+
+  std::unique_ptr<raw_fd_ostream> CSV;
+  if (!OutputFilename.empty()) {
+    bool NeedHeader = !sys::fs::exists(OutputFilename);
+    std::error_code EC;
+    CSV.reset(new raw_fd_ostream(OutputFilename, EC,
+                                 sys::fs::F_Text | sys::fs::F_Append));
+    if (EC) {
+      errs() << argv[0] << ": " << OutputFilename << ": " << EC.message()
+             << '\n';
+      return 1;
+    }
+    if (NeedHeader)
+      *CSV << "program,metric,runs,baseline,baseline_ci,optimized,"
+              "optimized_ci,speedup,speedup_low,speedup_high\n";
+  }
+
+  StringRef Program = Name.empty() ? StringRef(Baseline) : StringRef(Name);
+  outs() << Program << " (" << Runs << " runs, 95% confidence)\n";
+  Metric *Metrics[] = { &Wall, &CycleCounts, &InstructionCounts };
+  for (Metric *M : Metrics) {
+    if (M->Samples[0].empty() || M->Samples[1].empty())
+      continue;
+    Summary Base = summarize(M->Samples[0]);
+    Summary Opt = summarize(M->Samples[1]);
+    if (Opt.Mean == 0)
+      continue;
+
+    // The interval of the ratio of the means by the delta method: its
+    // relative variance is about the sum of those of the two means.
+    double Speedup = Base.Mean / Opt.Mean;
+    double RelVariance = 0;
+    if (Base.Mean != 0)
+      RelVariance += Base.Variance / M->Samples[0].size() /
+                     (Base.Mean * Base.Mean);
+    RelVariance += Opt.Variance / M->Samples[1].size() /
+                   (Opt.Mean * Opt.Mean);
+    size_t N = std::min(M->Samples[0].size(), M->Samples[1].size());
+    double HalfWidth = getCriticalT(N - 1) * Speedup * std::sqrt(RelVariance);
+
+    outs() << format("  %-12s %14.6g +- %-12.4g %14.6g +- %-12.4g "
+                     "speedup %.4f [%.4f, %.4f]\n",
+                     M->Name, Base.Mean, Base.HalfWidth, Opt.Mean,
+                     Opt.HalfWidth, Speedup, Speedup - HalfWidth,
+                     Speedup + HalfWidth);
+    if (CSV)
+      *CSV << Program << ',' << M->Name << ',' << Runs << ','
+           << format("%g,%g,%g,%g,%g,%g,%g\n", Base.Mean, Base.HalfWidth,
+                     Opt.Mean, Opt.HalfWidth, Speedup, Speedup - HalfWidth,
+                     Speedup + HalfWidth);
+  }
+  return 0;
+}
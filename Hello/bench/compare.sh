@@ -0,0 +1,101 @@
+#!/bin/bash
+#
+# Compare the hello pass with LLVM's own interprocedural constant
+# propagation, -ipconstprop and -ipsccp, on the test programs.
+#
+#   compare.sh <opt> <llc> <Hello.so> <hello-measure> <hello-speedup> \
+#              <out.csv> [runs]
+#
+# Every program of corpus.txt is compiled once to the unoptimized SSA
+# bitcode of pipeline.sh. Each engine runs on that bitcode, followed by the
+# same cleanup pipeline, so that only the interprocedural step differs. The
+# baseline is the cleanup pipeline alone. The CSV has one row per program
+# and engine:
+#
+#   program,engine,compile_seconds,peak_rss_kb,instructions_before,
+#   instructions_after,instructions_removed,speedup,speedup_low,speedup_high
+#
+# compile_seconds and peak_rss_kb are those of the opt run. The instruction
+# counts are those of the baseline and of the engine's build, both after the
+# cleanup; what the engines' own statistics count differs from one to the
+# next, so their difference is what stands for what each found. The counts
+# come from -instcount, which needs an opt built with statistics (with
+# assertions). The speedup is the runtime of the baseline over the engine's
+# build, with its 95% confidence interval. Set CLANG and CC as for
+# runtime.sh.
+
+set -e
+
+OPT=$1
+LLC=$2
+PLUGIN=$3
+MEASURE=$4
+SPEEDUP=$5
+OUT=$6
+RUNS=${7:-10}
+CLANG=${CLANG:-clang}
+CC=${CC:-cc}
+
+HERE=$(cd "$(dirname "$0")" && pwd)
+TESTS=$HERE/../test
+WORK=$(dirname "$OUT")/compare
+mkdir -p "$WORK"
+. "$HERE/pipeline.sh"
+
+# instructions <bitcode> - How many instructions the module has.
+instructions() {
+  $OPT -instcount -stats -disable-output "$1" 2> "$WORK/instcount.txt"
+  awk '{ i = index($0, " - ")
+         if (i && substr($0, i + 3) == "Number of instructions (of all types)")
+           { print $1; found = 1 } }
+       END { exit !found }' "$WORK/instcount.txt"
+}
+
+# A release opt ignores -stats, and every count would silently read 0.
+if ! echo 'define void @f() { ret void }' |
+     $OPT -instcount -stats -disable-output 2>&1 |
+     grep -q "Number of instructions (of all types)"; then
+  echo "compare.sh: $OPT prints no statistics; use one built with" \
+       "assertions" >&2
+  exit 1
+fi
+
+echo "program,engine,compile_seconds,peak_rss_kb,instructions_before," \
+     "instructions_after,instructions_removed,speedup,speedup_low," \
+     "speedup_high" | tr -d ' ' > "$OUT"
+
+while IFS=: read -r NAME SRC DEFINES; do
+  echo "== $NAME"
+  frontend "$TESTS/$SRC" "$DEFINES" "$WORK/$NAME.input.bc"
+  backend "$WORK/$NAME.input.bc" "$WORK/$NAME"
+  BEFORE=$(instructions "$WORK/$NAME.bc")
+
+  for ENGINE in hello ipconstprop ipsccp; do
+    case $ENGINE in
+      hello) FLAGS="-load=$PLUGIN -hello $HELLO_FLAGS" ;;
+      *) FLAGS="-$ENGINE" ;;
+    esac
+
+    BASE=$WORK/$NAME.$ENGINE
+    "$MEASURE" -o "$BASE.measure" $OPT $FLAGS "$WORK/$NAME.input.bc" \
+      -o "$BASE.engine.bc"
+    read -r SECONDS_WALL SECONDS_USER PEAK_KB < "$BASE.measure"
+    backend "$BASE.engine.bc" "$BASE"
+    AFTER=$(instructions "$BASE.bc")
+
+    if ! cmp -s <("$WORK/$NAME") <("$BASE"); then
+      echo "$NAME: output changed by $ENGINE" >&2
+      exit 1
+    fi
+    rm -f "$BASE.speedup"
+    "$SPEEDUP" -runs="$RUNS" -name="$NAME" -o "$BASE.speedup" \
+      "$WORK/$NAME" "$BASE" </dev/null
+    SPEEDUP_ROW=$(awk -F, '$2 == "seconds" { print $8 "," $9 "," $10 }' \
+                  "$BASE.speedup")
+
+    echo "$NAME,$ENGINE,$SECONDS_WALL,$PEAK_KB,$BEFORE,$AFTER," \
+         "$((BEFORE - AFTER)),$SPEEDUP_ROW" | tr -d ' ' >> "$OUT"
+  done
+done < "$HERE/corpus.txt"
+
+column -s, -t "$OUT" 2> /dev/null || cat "$OUT"
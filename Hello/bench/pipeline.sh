@@ -0,0 +1,37 @@
+#!/bin/bash
+#
+# The compile pipeline runtime.sh and compare.sh share, sourced by both
+# once OPT, LLC, CLANG and CC are set.
+#
+# clang's own -O1 already runs IPSCCP, GlobalOpt and DeadArgElim, which
+# would leave nothing for the engines under test to find. The sources are
+# therefore compiled without LLVM optimizations and only put in SSA form
+# (PRE_PASSES). Whatever runs on that bitcode, if anything, is followed by
+# the same intraprocedural cleanup (POST_PASSES), so that builds differ only
+# in the interprocedural constant propagation step. Both can be overridden
+# from the environment.
+#
+# Some test programs overflow signed integers in their arithmetic, so they
+# are compiled with -fwrapv. Otherwise their output would be undefined, and
+# comparing it between builds would prove nothing.
+
+PRE_PASSES=${PRE_PASSES:--mem2reg}
+POST_PASSES=${POST_PASSES:--instcombine -simplifycfg -early-cse -gvn -licm \
+-adce -simplifycfg}
+
+# frontend <source> <defines> <out.bc> - Compile a test program to SSA
+# bitcode that no interprocedural pass has seen.
+frontend() {
+  $CLANG -emit-llvm -O1 -Xclang -disable-llvm-optzns -fwrapv $2 \
+    -o "$3.raw" -c "$1"
+  $OPT $PRE_PASSES "$3.raw" -o "$3"
+  rm -f "$3.raw"
+}
+
+# backend <in.bc> <binary> - Run the cleanup on the bitcode, keeping it as
+# <binary>.bc, and build an executable from it.
+backend() {
+  $OPT $POST_PASSES "$1" -o "$2.bc"
+  $LLC "$2.bc" -o "$2.s"
+  $CC -o "$2" "$2.s"
+}
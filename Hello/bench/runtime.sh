@@ -0,0 +1,50 @@
+#!/bin/bash
+#
+# Measure how much faster the test programs run after the hello pass.
+#
+#   runtime.sh <opt> <llc> <Hello.so> <hello-speedup> <out.csv> [runs]
+#
+# Each program is compiled to unoptimized SSA bitcode once, then built
+# twice from it: through the cleanup pipeline of pipeline.sh alone, and
+# after opt -hello followed by the same cleanup. The programs, and the -D
+# bounds of the loops that would run to INT_MAX, are listed in corpus.txt.
+# Set CLANG and CC to choose the compiler and the linker driver, and
+# HELLO_FLAGS to pass options to the pass.
+
+set -e
+
+OPT=$1
+LLC=$2
+PLUGIN=$3
+SPEEDUP=$4
+OUT=$5
+RUNS=${6:-10}
+CLANG=${CLANG:-clang}
+CC=${CC:-cc}
+
+HERE=$(cd "$(dirname "$0")" && pwd)
+TESTS=$HERE/../test
+WORK=$(dirname "$OUT")/runtime
+mkdir -p "$WORK"
+rm -f "$OUT"
+. "$HERE/pipeline.sh"
+
+while IFS=: read -r NAME SRC DEFINES; do
+  echo "== $NAME"
+
+  frontend "$TESTS/$SRC" "$DEFINES" "$WORK/$NAME.input.bc"
+  $OPT -load="$PLUGIN" -hello $HELLO_FLAGS "$WORK/$NAME.input.bc" \
+    -o "$WORK/$NAME.hello.bc"
+
+  backend "$WORK/$NAME.input.bc" "$WORK/$NAME"
+  backend "$WORK/$NAME.hello.bc" "$WORK/$NAME.ipco"
+
+  # A speedup only counts if the program still computes the same thing.
+  if ! cmp -s <("$WORK/$NAME") <("$WORK/$NAME.ipco"); then
+    echo "$NAME: output changed by the hello pass" >&2
+    exit 1
+  fi
+
+  "$SPEEDUP" -runs="$RUNS" -name="$NAME" -o "$OUT" \
+    "$WORK/$NAME" "$WORK/$NAME.ipco" </dev/null
+done < "$HERE/corpus.txt"
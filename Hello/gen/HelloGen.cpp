@@ -0,0 +1,133 @@
+//===- HelloGen.cpp - Write synthetic modules for the hello pass ----------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Builds one module with the generator of SyntheticModule.h and writes it as
+// bitcode, so that opt can be stressed with modules far larger than clang
+// would produce from test sources in reasonable time:
+//
+//   hello-gen -shape=random -functions=1000000 -o big.bc
+//   opt -load=Hello.so -hello -time-passes big.bc -o /dev/null
+//
+//===----------------------------------------------------------------------===//
+
+#include "SyntheticModule.h"
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <string>
+
+using namespace llvm;
+
+static cl::opt<std::string> OutputFilename("o", cl::init("-"),
+    cl::value_desc("filename"), cl::desc("Where to write the module"));
+
+static cl::opt<bool> OutputAssembly("S",
+    cl::desc("Write textual IR instead of bitcode"));
+
+static cl::opt<bool> Verify("verify",
+    cl::desc("Run the verifier on the module before writing it"));
+
+static cl::opt<std::string> Shape("shape", cl::init("layered"),
+    cl::desc("Call graph: layered or random"));
+
+static cl::opt<unsigned> Functions("functions", cl::init(1000),
+    cl::desc("Internal functions of a random call graph"));
+static cl::opt<unsigned> Depth("depth", cl::init(8),
+    cl::desc("Levels of a layered call graph"));
+static cl::opt<unsigned> Roots("roots", cl::init(4),
+    cl::desc("Functions the entry calls"));
+static cl::opt<unsigned> FanOut("fan-out", cl::init(2),
+    cl::desc("Calls each function makes"));
+static cl::opt<unsigned> FanIn("fan-in", cl::init(2),
+    cl::desc("Calls each function of a layered graph receives"));
+static cl::opt<unsigned> MaxWidth("max-width", cl::init(1024),
+    cl::desc("Most functions in one level of a layered graph"));
+static cl::opt<unsigned> Args("args", cl::init(3),
+    cl::desc("Formals per function"));
+static cl::opt<unsigned> BodySize("body", cl::init(16),
+    cl::desc("Arithmetic instructions per function"));
+static cl::opt<unsigned> ConstantPercent("constant-percent", cl::init(67),
+    cl::desc("Share of actuals, in percent, that are literals"));
+static cl::opt<unsigned> Cycles("cycles", cl::init(0),
+    cl::desc("Calls back to earlier functions, forming recursion cycles"));
+static cl::opt<unsigned> Chains("chains", cl::init(0),
+    cl::desc("Straight-line functions like massive_compute"));
+static cl::opt<unsigned> ChainSize("chain-size", cl::init(10000),
+    cl::desc("Instructions of each straight-line function"));
+static cl::opt<unsigned> IdiomPercent("idiom-percent", cl::init(0),
+    cl::desc("Share of functions, in percent, that also use switches, "
+             "globals, local slots, structs and function pointers"));
+static cl::opt<unsigned> Seed("seed", cl::init(1),
+    cl::desc("Seed of the generator"));
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv,
+                              "synthetic module generator for the hello pass\n");
+
+  hello::SyntheticConfig Config;
+  if (Shape == "random")
+    Config.Shape = hello::SyntheticConfig::RandomDAG;
+  else if (Shape != "layered") {
+    errs() << argv[0] << ": unknown shape '" << Shape << "'\n";
+    return 1;
+  }
+  Config.Functions = Functions;
+  Config.Depth = Depth;
+  Config.Roots = Roots;
+  Config.FanOut = FanOut;
+  Config.FanIn = FanIn;
+  Config.MaxWidth = MaxWidth;
+  Config.Args = Args;
+  Config.BodySize = BodySize;
+  Config.ConstantPercent = ConstantPercent;
+  Config.RecursionCycles = Cycles;
+  Config.StraightLineFunctions = Chains;
+  Config.StraightLineSize = ChainSize;
+  Config.IdiomPercent = IdiomPercent;
+  Config.Seed = Seed;
+
+  LLVMContext Ctx;
+  double Start = TimeRecord::getCurrentTime(true).getWallTime();
+  std::unique_ptr<Module> M = hello::buildSyntheticModule(Ctx, Config);
+  double Built = TimeRecord::getCurrentTime(false).getWallTime();
+
+  if (Verify && verifyModule(*M, &errs())) {
+    errs() << argv[0] << ": generated an invalid module\n";
+    return 1;
+  }
+
+  std::error_code EC;
+  raw_fd_ostream Out(OutputFilename, EC,
+                     OutputAssembly ? sys::fs::F_Text : sys::fs::F_None);
+  if (EC) {
+    errs() << argv[0] << ": " << OutputFilename << ": " << EC.message()
+           << '\n';
+    return 1;
+  }
+  if (OutputAssembly)
+    M->print(Out, nullptr);
+  else
+    WriteBitcodeToFile(M.get(), Out);
+  double Written = TimeRecord::getCurrentTime(false).getWallTime();
+
+  unsigned Instructions = 0;
+  for (Function &F : *M)
+    for (BasicBlock &BB : F)
+      Instructions += BB.size();
+  errs() << M->size() << " functions, " << Instructions
+         << " instructions; built in " << Built - Start << "s, written in "
+         << Written - Built << "s\n";
+  return 0;
+}
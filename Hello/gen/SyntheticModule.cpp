@@ -0,0 +1,363 @@
+//===- SyntheticModule.cpp - Parameterized call graphs for the pass -------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the module generator described in SyntheticModule.h.
+//
+//===----------------------------------------------------------------------===//
+
+#include "SyntheticModule.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Module.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+  /// SyntheticBuilder - Fills in the functions of one generated module.
+  class SyntheticBuilder {
+    const hello::SyntheticConfig &Config;
+    Module &M;
+    LLVMContext &Ctx;
+    std::mt19937 Rng;
+    unsigned NumArgs;
+    FunctionType *FTy;
+    // The internal functions, the ones each calls, the earlier function it
+    // calls back to (if any), and the ones the entry calls.
+    std::vector<Function*> Funcs;
+    std::vector<std::vector<Function*>> Callees;
+    std::vector<Function*> BackEdges;
+    std::vector<Function*> Roots;
+    // What the functions using the idioms of Config.IdiomPercent share.
+    std::vector<GlobalVariable*> Globals;
+    Function *Deref = nullptr;
+    Function *Apply = nullptr;
+    Function *Pair = nullptr;
+
+  public:
+    SyntheticBuilder(const hello::SyntheticConfig &Config, Module &M)
+      : Config(Config), M(M), Ctx(M.getContext()), Rng(Config.Seed),
+        NumArgs(std::max(Config.Args, 1u)) {
+      Type *Int32Ty = Type::getInt32Ty(Ctx);
+      FTy = FunctionType::get(Int32Ty, std::vector<Type*>(NumArgs, Int32Ty),
+                              false);
+    }
+
+    void build() {
+      // Lay out the whole call graph first so that calls can refer to any
+      // function.
+      if (Config.Shape == hello::SyntheticConfig::RandomDAG)
+        layOutRandomDAG();
+      else
+        layOutLevels();
+      if (Config.IdiomPercent)
+        buildHelpers();
+
+      for (unsigned i = 0, e = Funcs.size(); i != e; ++i)
+        buildBody(i);
+      std::vector<Function*> Chains;
+      for (unsigned i = 0; i != Config.StraightLineFunctions; ++i)
+        Chains.push_back(buildStraightLine(i));
+      buildEntry(Chains);
+    }
+
+  private:
+    Function *createFunction(const Twine &Name) {
+      Funcs.push_back(Function::Create(FTy, GlobalValue::InternalLinkage,
+                                       Name, &M));
+      Callees.emplace_back();
+      BackEdges.push_back(nullptr);
+      return Funcs.back();
+    }
+
+    void layOutLevels() {
+      std::vector<std::vector<unsigned>> Levels;
+      unsigned Width = std::max(Config.Roots, 1u);
+      for (unsigned L = 0, E = std::max(Config.Depth, 1u); L != E; ++L) {
+        std::vector<unsigned> Level;
+        for (unsigned i = 0; i != Width; ++i) {
+          Level.push_back(Funcs.size());
+          createFunction("f" + Twine(L) + "_" + Twine(i));
+        }
+        Levels.push_back(Level);
+        uint64_t Next = uint64_t(Width) * Config.FanOut /
+                        std::max(Config.FanIn, 1u);
+        Width = unsigned(std::max<uint64_t>(
+          1, std::min<uint64_t>(Next, std::max(Config.MaxWidth, 1u))));
+      }
+
+      for (unsigned L = 0, E = Levels.size(); L != E; ++L)
+        for (unsigned i = 0, W = Levels[L].size(); i != W; ++i) {
+          unsigned F = Levels[L][i];
+          if (L + 1 != E) {
+            const std::vector<unsigned> &Next = Levels[L + 1];
+            for (unsigned k = 0; k != Config.FanOut; ++k) {
+              uint64_t Callee = (uint64_t(i) * Config.FanOut + k) /
+                                std::max(Config.FanIn, 1u);
+              Callees[F].push_back(Funcs[Next[Callee % Next.size()]]);
+            }
+          } else if (i < Config.RecursionCycles) {
+            BackEdges[F] = Funcs[Levels[0][i % Levels[0].size()]];
+          }
+        }
+      for (unsigned F : Levels[0])
+        Roots.push_back(Funcs[F]);
+    }
+
+    void layOutRandomDAG() {
+      unsigned N = std::max(Config.Functions, 1u);
+      unsigned NumRoots = std::min(std::max(Config.Roots, 1u), N);
+      for (unsigned i = 0; i != N; ++i)
+        createFunction("f" + Twine(i));
+
+      // A random recursive tree reaches every function in about log N
+      // calls; the extra calls make it a DAG.
+      for (unsigned k = NumRoots; k != N; ++k)
+        Callees[Rng() % k].push_back(Funcs[k]);
+      for (unsigned i = 0; i + 1 < N; ++i)
+        for (unsigned k = 1; k < Config.FanOut; ++k)
+          Callees[i].push_back(Funcs[i + 1 + Rng() % (N - i - 1)]);
+      for (unsigned c = 0; c != Config.RecursionCycles; ++c) {
+        unsigned From = Rng() % N;
+        BackEdges[From] = Funcs[Rng() % (From + 1)];
+      }
+      Roots.assign(Funcs.begin(), Funcs.begin() + NumRoots);
+    }
+
+    // getActuals - The arguments call number Site of a function passes:
+    // a literal shared by every call, a literal from a small set, or one
+    // of the caller's own formals. With recursion cycles the last formal
+    // is the count down bounding them, so it is always passed on as is.
+    std::vector<Value*> getActuals(IRBuilder<> &B,
+                                   const std::vector<Value*> &Formals,
+                                   unsigned Site) {
+      std::vector<Value*> Actuals;
+      for (unsigned a = 0; a != NumArgs; ++a) {
+        if (Config.RecursionCycles && a + 1 == NumArgs) {
+          Actuals.push_back(Formals.back());
+          continue;
+        }
+        unsigned Roll = Rng() % 200;
+        if (Roll < Config.ConstantPercent)
+          Actuals.push_back(B.getInt32(7 + a));
+        else if (Roll < 2 * Config.ConstantPercent)
+          Actuals.push_back(B.getInt32(Site % 3));
+        else
+          Actuals.push_back(Formals[a % Formals.size()]);
+      }
+      return Actuals;
+    }
+
+    // buildHelpers - The internal globals and the helpers that functions
+    // using the idioms go through: deref reads a slot through a pointer
+    // formal, apply calls a function-pointer formal, and pair returns a
+    // struct.
+    void buildHelpers() {
+      Type *Int32Ty = Type::getInt32Ty(Ctx);
+      for (unsigned i = 0; i != 4; ++i)
+        Globals.push_back(new GlobalVariable(
+          M, Int32Ty, false, GlobalValue::InternalLinkage,
+          ConstantInt::get(Int32Ty, i == 0 ? 3 : Rng() % 5), "g" + Twine(i)));
+
+      Type *DerefParams[] = { PointerType::getUnqual(Int32Ty), Int32Ty };
+      Deref = Function::Create(FunctionType::get(Int32Ty, DerefParams, false),
+                               GlobalValue::InternalLinkage, "deref", &M);
+      IRBuilder<> B(BasicBlock::Create(Ctx, "entry", Deref));
+      Function::arg_iterator DA = Deref->arg_begin();
+      Value *Slot = &*DA++;
+      B.CreateRet(B.CreateXor(B.CreateLoad(Int32Ty, Slot), &*DA));
+
+      std::vector<Type*> ApplyParams(1, PointerType::getUnqual(FTy));
+      ApplyParams.insert(ApplyParams.end(), NumArgs, Int32Ty);
+      Apply = Function::Create(FunctionType::get(Int32Ty, ApplyParams, false),
+                               GlobalValue::InternalLinkage, "apply", &M);
+      B.SetInsertPoint(BasicBlock::Create(Ctx, "entry", Apply));
+      Function::arg_iterator AA = Apply->arg_begin();
+      Value *Callee = &*AA++;
+      std::vector<Value*> Forwarded;
+      for (Function::arg_iterator AE = Apply->arg_end(); AA != AE; ++AA)
+        Forwarded.push_back(&*AA);
+      B.CreateRet(B.CreateCall(FTy, Callee, Forwarded));
+
+      Type *Fields[] = { Int32Ty, Int32Ty };
+      StructType *PairTy = StructType::get(Ctx, makeArrayRef(Fields));
+      Type *PairParams[] = { Int32Ty, Int32Ty };
+      Pair = Function::Create(FunctionType::get(PairTy, PairParams, false),
+                              GlobalValue::InternalLinkage, "pair", &M);
+      B.SetInsertPoint(BasicBlock::Create(Ctx, "entry", Pair));
+      Function::arg_iterator PA = Pair->arg_begin();
+      Value *First = &*PA++;
+      Value *Result = B.CreateInsertValue(UndefValue::get(PairTy),
+                                          B.CreateAdd(First, B.getInt32(1)),
+                                          0);
+      B.CreateRet(B.CreateInsertValue(Result, &*PA, 1));
+    }
+
+    // buildIdioms - Run the accumulator of a function through a global,
+    // a local slot and a struct.
+    Value *buildIdioms(IRBuilder<> &B, const std::vector<Value*> &Formals,
+                       Value *Acc) {
+      GlobalVariable *G = Globals[Rng() % Globals.size()];
+      if (Rng() % 2)
+        B.CreateStore(Rng() % 2 ? B.getInt32(3) : Formals[Rng() % NumArgs],
+                      G);
+      else
+        Acc = B.CreateAdd(Acc, B.CreateLoad(B.getInt32Ty(), G));
+
+      Value *Slot = B.CreateAlloca(B.getInt32Ty());
+      B.CreateStore(Rng() % 2 ? B.getInt32(11) : Acc, Slot);
+      Value *DerefArgs[] = { Slot, Acc };
+      Acc = B.CreateCall(Deref, DerefArgs);
+
+      Value *PairArgs[] = { Acc, Formals[0] };
+      Value *Fields = B.CreateCall(Pair, PairArgs);
+      Value *First = B.CreateExtractValue(Fields, 0);
+      return B.CreateAdd(First, B.CreateExtractValue(Fields, 1));
+    }
+
+    void buildBody(unsigned Index) {
+      Function *F = Funcs[Index];
+      std::vector<Value*> Formals;
+      for (Argument &A : F->args())
+        Formals.push_back(&A);
+      bool Idioms = Config.IdiomPercent &&
+                    Rng() % 100 < Config.IdiomPercent;
+
+      BasicBlock *Entry = BasicBlock::Create(Ctx, "entry", F);
+      BasicBlock *Then = BasicBlock::Create(Ctx, "then", F);
+      BasicBlock *Else = BasicBlock::Create(Ctx, "else", F);
+      BasicBlock *Join = BasicBlock::Create(Ctx, "join", F);
+      IRBuilder<> B(Entry);
+
+      static const Instruction::BinaryOps Ops[] = {
+        Instruction::Add, Instruction::Mul, Instruction::Xor
+      };
+      Value *Acc = Formals[0];
+      for (unsigned b = 0; b != Config.BodySize; ++b) {
+        Value *Operand = Rng() % 2 ? Formals[Rng() % NumArgs]
+                                   : B.getInt32(Rng() % 97 + 1);
+        Acc = B.CreateBinOp(Ops[Rng() % 3], Acc, Operand);
+      }
+      if (Idioms)
+        Acc = buildIdioms(B, Formals, Acc);
+      Value *Decider = Formals[NumArgs > 1 ? 1 : 0];
+      if (Idioms) {
+        SwitchInst *SI = B.CreateSwitch(Decider, Else, 2);
+        SI->addCase(B.getInt32(1), Then);
+        SI->addCase(B.getInt32(8), Then);
+      } else {
+        B.CreateCondBr(B.CreateICmpEQ(Decider, B.getInt32(1)), Then, Else);
+      }
+
+      B.SetInsertPoint(Then);
+      Value *ThenAcc = B.CreateAdd(Acc, B.getInt32(1));
+      B.CreateBr(Join);
+      B.SetInsertPoint(Else);
+      Value *ElseAcc = B.CreateSub(Acc, Decider);
+      B.CreateBr(Join);
+
+      B.SetInsertPoint(Join);
+      PHINode *Merged = B.CreatePHI(B.getInt32Ty(), 2);
+      Merged->addIncoming(ThenAcc, Then);
+      Merged->addIncoming(ElseAcc, Else);
+      Acc = Merged;
+
+      for (unsigned k = 0, e = Callees[Index].size(); k != e; ++k) {
+        std::vector<Value*> Actuals = getActuals(B, Formals, Index + k);
+        Value *R;
+        if (Idioms && k == 0) {
+          Actuals.insert(Actuals.begin(), Callees[Index][k]);
+          R = B.CreateCall(Apply, Actuals);
+        } else {
+          R = B.CreateCall(Callees[Index][k], Actuals);
+        }
+        Acc = B.CreateAdd(Acc, R);
+      }
+
+      if (Function *Back = BackEdges[Index]) {
+        // Call back while the last formal counts down.
+        BasicBlock *Rec = BasicBlock::Create(Ctx, "rec", F);
+        BasicBlock *Exit = BasicBlock::Create(Ctx, "exit", F);
+        BasicBlock *From = B.GetInsertBlock();
+        Value *Counter = Formals.back();
+        B.CreateCondBr(B.CreateICmpSGT(Counter, B.getInt32(0)), Rec, Exit);
+
+        B.SetInsertPoint(Rec);
+        std::vector<Value*> Actuals = getActuals(B, Formals, Index);
+        Actuals.back() = B.CreateSub(Counter, B.getInt32(1));
+        Value *R = B.CreateCall(Back, Actuals);
+        Value *RecAcc = B.CreateAdd(Acc, R);
+        B.CreateBr(Exit);
+
+        B.SetInsertPoint(Exit);
+        PHINode *Result = B.CreatePHI(B.getInt32Ty(), 2);
+        Result->addIncoming(Acc, From);
+        Result->addIncoming(RecAcc, Rec);
+        Acc = Result;
+      }
+      B.CreateRet(Acc);
+    }
+
+    // buildStraightLine - A function of four i32 formals computing one long
+    // i64 chain, each step the last value combined with a random earlier
+    // one, the way extra/massive_gen.py writes massive_compute.
+    Function *buildStraightLine(unsigned Index) {
+      Type *Int32Ty = Type::getInt32Ty(Ctx);
+      Type *Int64Ty = Type::getInt64Ty(Ctx);
+      Function *F = Function::Create(
+        FunctionType::get(Int64Ty, std::vector<Type*>(4, Int32Ty), false),
+        GlobalValue::InternalLinkage, "chain" + Twine(Index), &M);
+      IRBuilder<> B(BasicBlock::Create(Ctx, "entry", F));
+
+      std::vector<Value*> Defined;
+      Defined.reserve(Config.StraightLineSize + 4);
+      for (Argument &A : F->args())
+        Defined.push_back(B.CreateSExt(&A, Int64Ty));
+      static const Instruction::BinaryOps Ops[] = {
+        Instruction::Add, Instruction::Sub, Instruction::Mul
+      };
+      for (unsigned i = 0; i != Config.StraightLineSize; ++i)
+        Defined.push_back(B.CreateBinOp(Ops[Rng() % 3], Defined.back(),
+                                        Defined[Rng() % Defined.size()]));
+      B.CreateRet(Defined.back());
+      return F;
+    }
+
+    // buildEntry - The external function calling every root and chain, so
+    // that nothing is dead and every formal starts from the same literals.
+    void buildEntry(const std::vector<Function*> &Chains) {
+      Type *Int32Ty = Type::getInt32Ty(Ctx);
+      Function *Main = Function::Create(
+        FunctionType::get(Int32Ty, Int32Ty, false),
+        GlobalValue::ExternalLinkage, "synthetic_main", &M);
+      IRBuilder<> B(BasicBlock::Create(Ctx, "entry", Main));
+      std::vector<Value*> Formals(1, &*Main->arg_begin());
+      Value *Acc = B.getInt32(0);
+      for (unsigned i = 0, e = Roots.size(); i != e; ++i)
+        Acc = B.CreateAdd(Acc, B.CreateCall(Roots[i],
+                                            getActuals(B, Formals, i)));
+      for (Function *Chain : Chains) {
+        Value *Args[] = { B.getInt32(1), B.getInt32(2), B.getInt32(3),
+                          B.getInt32(4) };
+        Value *R = B.CreateCall(Chain, Args);
+        Acc = B.CreateAdd(Acc, B.CreateTrunc(R, Int32Ty));
+      }
+      B.CreateRet(Acc);
+    }
+  };
+}
+
+std::unique_ptr<Module>
+hello::buildSyntheticModule(LLVMContext &Ctx, const SyntheticConfig &Config) {
+  std::unique_ptr<Module> M(new Module("synthetic", Ctx));
+  SyntheticBuilder(Config, *M).build();
+  return M;
+}
@@ -0,0 +1,92 @@
+//===- SyntheticModule.h - Parameterized call graphs for the pass -*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Builds modules shaped like the ones the hello pass is tuned for, directly
+// in memory, so that its compile time can be measured as each dimension of
+// the call graph grows.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef HELLO_GEN_SYNTHETICMODULE_H
+#define HELLO_GEN_SYNTHETICMODULE_H
+
+#include <memory>
+
+namespace llvm {
+class LLVMContext;
+class Module;
+}
+
+namespace hello {
+
+/// SyntheticConfig - The shape of a generated module. With the Layered
+/// shape, internal functions are laid out in Depth levels below an external
+/// entry point; the entry calls each of the Roots functions of level 0, and
+/// every function calls FanOut functions of the next level, spread so that
+/// each of those is called from about FanIn places. A level therefore holds
+/// FanOut / FanIn times as many functions as the one above it, up to
+/// MaxWidth.
+///
+/// With the RandomDAG shape there are Functions internal functions instead,
+/// the first Roots of them called from the entry. Every other function is
+/// called from one random function before it, which keeps the call graph
+/// shallow, and each function makes FanOut - 1 more calls to random
+/// functions after it.
+///
+/// Every function takes Args i32 formals and computes BodySize arithmetic
+/// instructions before branching on its second formal. Of the actuals
+/// passed at each call, ConstantPercent percent are literals, half of them
+/// the same literal everywhere and half one of a few depending on the call;
+/// the rest forward a formal of the caller, so propagation has constants,
+/// small constant sets and chains of them to find. RecursionCycles
+/// functions call back to an earlier function while their last formal,
+/// which every call passes on and these calls decrement, is positive. That
+/// folds the call graph into SCCs, yet every call of the entry returns;
+/// in the Layered shape, functions of the last level call into level 0.
+///
+/// StraightLineFunctions more functions are straight-line i64 chains of
+/// StraightLineSize instructions like massive_compute in test/massive.c,
+/// each step combining the previous value with a random earlier one; the
+/// entry calls them with literals.
+///
+/// IdiomPercent percent of the internal functions also use the constructs
+/// the pass models beyond plain calls of i32 formals: they branch on their
+/// second formal with a switch, store a value to or load one from a few
+/// internal globals, pass a pointer to a local slot holding a constant or
+/// their accumulator to a helper that reads it, combine two values through
+/// a struct a helper returns, and make their first call through a helper
+/// that takes the callee as a function pointer.
+struct SyntheticConfig {
+  enum ShapeKind { Layered, RandomDAG };
+
+  ShapeKind Shape = Layered;
+  unsigned Depth = 8;
+  unsigned Roots = 4;
+  unsigned Functions = 1000;
+  unsigned FanOut = 2;
+  unsigned FanIn = 2;
+  unsigned MaxWidth = 1024;
+  unsigned Args = 3;
+  unsigned BodySize = 16;
+  unsigned ConstantPercent = 67;
+  unsigned RecursionCycles = 0;
+  unsigned StraightLineFunctions = 0;
+  unsigned StraightLineSize = 10000;
+  unsigned IdiomPercent = 0;
+  unsigned Seed = 1;
+};
+
+/// buildSyntheticModule - Generate a module with the shape of Config. The
+/// same configuration always produces the same module.
+std::unique_ptr<llvm::Module>
+buildSyntheticModule(llvm::LLVMContext &Ctx, const SyntheticConfig &Config);
+
+} // end namespace hello
+
+#endif
@@ -0,0 +1,51 @@
+; A function handed to a broker is called back with the operands the broker
+; was given, or with arguments of the broker's own. pthread_create passes
+; its last operand on, which here is always @state; qsort fills in both
+; arguments of the comparator itself:
+;
+;   opt -load=Hello.so -hello -S broker.ll
+;
+; @worker must load and store @state directly, yet keep its formal, since
+; pthread_create still calls it with one. @compare must be left as it is,
+; and the load of @state in @main must stay.
+
+%union.pthread_attr_t = type { i64, [48 x i8] }
+
+@state = internal global i32 7
+@table = internal global [4 x i32] [i32 3, i32 1, i32 4, i32 1]
+
+declare i32 @pthread_create(i64*, %union.pthread_attr_t*, i8* (i8*)*, i8*)
+declare i32 @pthread_join(i64, i8**)
+declare void @qsort(i8*, i64, i64, i32 (i8*, i8*)*)
+
+define internal i8* @worker(i8* %arg) {
+entry:
+  %p = bitcast i8* %arg to i32*
+  %v = load i32, i32* %p
+  %w = add i32 %v, 1
+  store i32 %w, i32* %p
+  ret i8* null
+}
+
+define internal i32 @compare(i8* %a, i8* %b) {
+entry:
+  %pa = bitcast i8* %a to i32*
+  %pb = bitcast i8* %b to i32*
+  %va = load i32, i32* %pa
+  %vb = load i32, i32* %pb
+  %d = sub i32 %va, %vb
+  ret i32 %d
+}
+
+define i32 @main() {
+entry:
+  %tid = alloca i64
+  %rc = call i32 @pthread_create(i64* %tid, %union.pthread_attr_t* null, i8* (i8*)* @worker, i8* bitcast (i32* @state to i8*))
+  %t = load i64, i64* %tid
+  %j = call i32 @pthread_join(i64 %t, i8** null)
+  call void @qsort(i8* bitcast ([4 x i32]* @table to i8*), i64 4, i64 4, i32 (i8*, i8*)* @compare)
+  %s = load i32, i32* @state
+  %first = load i32, i32* getelementptr ([4 x i32], [4 x i32]* @table, i64 0, i64 0)
+  %sum = add i32 %s, %first
+  ret i32 %sum
+}
@@ -0,0 +1,45 @@
+; A formal every call passes the same constant is folded into the body and
+; removed from the prototype, from calls and invokes alike, and the
+; attributes of the other formals stay with them. The cleanup is left out
+; so that the invoke is not simplified away:
+;
+;   opt -load=Hello.so -hello -hello-cleanup=0 -S dead_args.ll
+;
+; @scale must be left with the single formal "i32 signext %x" and multiply
+; by 3; it must be called with %n and invoked with %m alone. @exported can
+; be called from outside the module, so it must keep %factor.
+
+declare i32 @opaque(i32)
+declare i32 @__gxx_personality_v0(...)
+
+define internal i32 @scale(i32 signext %x, i32 %factor) {
+entry:
+  %r = mul i32 %x, %factor
+  ret i32 %r
+}
+
+define i32 @exported(i32 %x, i32 %factor) {
+entry:
+  %r = mul i32 %x, %factor
+  ret i32 %r
+}
+
+define i32 @main() personality i32 (...)* @__gxx_personality_v0 {
+entry:
+  %n = call i32 @opaque(i32 0)
+  %a = call i32 @scale(i32 signext %n, i32 3)
+  %m = call i32 @opaque(i32 1)
+  %b = invoke i32 @scale(i32 signext %m, i32 3)
+          to label %normal unwind label %lpad
+
+normal:
+  %c = call i32 @exported(i32 %n, i32 3)
+  %ab = add i32 %a, %b
+  %abc = add i32 %ab, %c
+  ret i32 %abc
+
+lpad:
+  %lp = landingpad { i8*, i32 }
+          cleanup
+  resume { i8*, i32 } %lp
+}
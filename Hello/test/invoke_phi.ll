@@ -0,0 +1,59 @@
+; The result of an invoke is whatever its callee returns on the normal edge,
+; never nothing. Merging it with a constant in a PHI, returning it or storing
+; it to an internal global must not let the constant through:
+;
+;   opt -load=Hello.so -hello -S invoke_phi.ll
+;
+; @pick must still return %merged, @forward must still return %r, and the
+; load of @g in @main must stay.
+
+@g = internal global i32 5
+
+declare i32 @opaque(i32)
+declare i32 @__gxx_personality_v0(...)
+
+define internal i32 @pick(i32 %n) personality i32 (...)* @__gxx_personality_v0 {
+entry:
+  %c = call i32 @opaque(i32 0)
+  %skip = icmp eq i32 %c, 0
+  br i1 %skip, label %done, label %call
+
+call:
+  %r = invoke i32 @opaque(i32 %n)
+          to label %normal unwind label %lpad
+
+normal:
+  br label %done
+
+done:
+  %merged = phi i32 [ 5, %entry ], [ %r, %normal ]
+  ret i32 %merged
+
+lpad:
+  %lp = landingpad { i8*, i32 }
+          cleanup
+  resume { i8*, i32 } %lp
+}
+
+define internal i32 @forward(i32 %n) personality i32 (...)* @__gxx_personality_v0 {
+entry:
+  %r = invoke i32 @pick(i32 %n)
+          to label %normal unwind label %lpad
+
+normal:
+  store i32 %r, i32* @g
+  ret i32 %r
+
+lpad:
+  %lp = landingpad { i8*, i32 }
+          cleanup
+  resume { i8*, i32 } %lp
+}
+
+define i32 @main() {
+entry:
+  %r = call i32 @forward(i32 3)
+  %v = load i32, i32* @g
+  %sum = add i32 %r, %v
+  ret i32 %sum
+}
@@ -1,6 +1,12 @@
 #include <stdio.h>
 #include <limits.h>
 
+/* Iterations of the loop in main; lower it with -D to use this test as a
+   benchmark. */
+#ifndef ITERATIONS
+#define ITERATIONS INT_MAX
+#endif
+
 long massive_compute(int a, int b, int c, int d) {
 long zrrtk = d - b;
 long acjae = zrrtk - c;
@@ -10011,7 +10017,7 @@ int main() {
   int b = 2;
   int c = 3;
   int d = 4;
-  for(;i<INT_MAX;++i){
+  for(;i<ITERATIONS;++i){
     result1 = massive_compute(a, b, c, d);
     result2 = (result1/1000) - massive_compute(a, b, c, d);
   }
@@ -2,6 +2,15 @@
 #include "stdlib.h"
 #include "limits.h"
 
+/* Iterations of the loop in main, and the bound on i * monkeyz in monkey;
+   lower them with -D to use this test as a benchmark. */
+#ifndef ITERATIONS
+#define ITERATIONS INT_MAX
+#endif
+#ifndef MONKEY_BOUND
+#define MONKEY_BOUND INT_MAX
+#endif
+
 int baz (int z){
   int x = z+9;
   return x;
@@ -10,7 +19,7 @@ int baz (int z){
 int monkey(int monkeyz){
   int i = 0;
   int x = 0;
-  for(;(i*monkeyz)<INT_MAX;++i){
+  for(;(i*monkeyz)<MONKEY_BOUND;++i){
     x = monkeyz + baz(monkeyz);
   }
   return x;
@@ -63,15 +72,16 @@ int main(void){
   int x=9995;
   int y=5;
   int i;
-  int z = 0;
-  int r = 0;
-  for(i=1;(i-x)<INT_MAX;i++){
+  /* Unsigned, so that the sum wraps instead of overflowing. */
+  unsigned z = 0;
+  unsigned r = 0;
+  for(i=0;i<ITERATIONS;i++){
     r = z+foo(x,y);
     z = z + r + 1;
     r = y+foo(x,y);
     z = z + r + 2;
   }
-  printf("!!!!!Value: %d\n",z*y);
+  printf("!!!!!Value: %u\n",z*y);
   //int z=foo(5,8); 
 }
 
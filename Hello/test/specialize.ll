@@ -0,0 +1,35 @@
+; A formal that is switched on and always receives a literal is cloned away:
+; each distinct constant gets a copy with the formal folded in, and every
+; call goes to the copy for the value it passes:
+;
+;   opt -load=Hello.so -hello -hello-specialize -S specialize.ll
+;
+; @main must call @step.spec, which only adds 1, with %n and %r1, and
+; @step.spec.1, which only shifts left by 1, with %r0. No call may be left
+; to @step.
+
+declare i32 @opaque(i32)
+
+define internal i32 @step(i32 %op, i32 %x) {
+entry:
+  switch i32 %op, label %other [ i32 0, label %inc
+                                 i32 1, label %dbl ]
+inc:
+  %a = add i32 %x, 1
+  ret i32 %a
+dbl:
+  %b = shl i32 %x, 1
+  ret i32 %b
+other:
+  %c = sub i32 0, %x
+  ret i32 %c
+}
+
+define i32 @main() {
+entry:
+  %n = call i32 @opaque(i32 0)
+  %r0 = call i32 @step(i32 0, i32 %n)
+  %r1 = call i32 @step(i32 1, i32 %r0)
+  %r2 = call i32 @step(i32 0, i32 %r1)
+  ret i32 %r2
+}
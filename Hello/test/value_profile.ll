@@ -0,0 +1,45 @@
+; A call whose formal the value profile shows to be mostly one constant is
+; guarded on it: when the actual equals it the call goes to a copy for that
+; constant, otherwise to the original. value_profile.txt holds the profile:
+;
+;   opt -load=Hello.so -hello -hello-specialize -hello-context-depth=2 \
+;     -hello-value-profile-use=value_profile.txt -S value_profile.ll
+;
+; The call of @scale in @main must test "%n == 8" and call @scale.spec,
+; which returns 8, on the equal path. @scale.spec only serves that call,
+; which passes 1 for %m. The call through @apply with 8 and %x must
+; therefore go to another copy, which still multiplies %m by 8.
+
+declare i32 @opaque(i32)
+
+define internal i32 @scale(i32 %k, i32 %m) {
+entry:
+  %big = icmp sgt i32 %k, 4
+  br i1 %big, label %wide, label %narrow
+
+wide:
+  %w = mul i32 %m, %k
+  ret i32 %w
+
+narrow:
+  %n = add i32 %m, %k
+  ret i32 %n
+}
+
+define internal i32 @apply(i32 (i32, i32)* %fn, i32 %k, i32 %m) {
+entry:
+  %r = call i32 %fn(i32 %k, i32 %m)
+  ret i32 %r
+}
+
+define i32 @main() {
+entry:
+  %n = call i32 @opaque(i32 8)
+  %x = call i32 @opaque(i32 2)
+  %a = call i32 @scale(i32 %n, i32 1)
+  %b = call i32 @apply(i32 (i32, i32)* @scale, i32 8, i32 %x)
+  %c = call i32 @apply(i32 (i32, i32)* @scale, i32 3, i32 5)
+  %ab = add i32 %a, %b
+  %abc = add i32 %ab, %c
+  ret i32 %abc
+}